@@ -12,46 +12,153 @@
 
 #include "mem/buddysystem.h"
 #include "mem/paging.h"
+#include "hardware/timer.h"
+#include "klib/irqflags.h"
 #include "assert.h"
+#include "string.h"
+#include "stdio.h"
+#include "stdarg.h"
 #include "io/debug.h"
 #include "system/panic.h"
 
-/// @brief Cache level low limit after which allocation starts.
+/// @brief Initial cache level low limit after which allocation starts.
 #define LOW_WATERMARK_LEVEL 10
-/// @brief Cache level high limit, above it deallocation happens.
+/// @brief Initial cache level high limit, above it deallocation happens.
 #define HIGH_WATERMARK_LEVEL 70
-/// @brief Cache level midway limit.
+/// @brief Initial cache level midway limit.
 #define MID_WATERMARK_LEVEL ((LOW_WATERMARK_LEVEL + HIGH_WATERMARK_LEVEL) / 2)
 
-/// @brief Bitwise flags for identifying page types and statuses.
+/// @brief Smallest midway limit the cache can shrink to when idle.
+#ifndef CACHE_MIN_MID_LEVEL
+#define CACHE_MIN_MID_LEVEL 8
+#endif
+/// @brief Largest midway limit the cache can grow to during bursts.
+#ifndef CACHE_MAX_MID_LEVEL
+#define CACHE_MAX_MID_LEVEL 512
+#endif
+/// @brief Length of the period over which the cache alloc/free rate is sampled.
+#define CACHE_SAMPLE_TICKS (TICKS_PER_SECOND / 10)
+/// @brief Number of idle periods after which the rate history is discarded.
+#define CACHE_MAX_IDLE_PERIODS 16
+
+/// @brief Default coalescing mode of new instances: eager (0) or lazy (1).
+#ifndef BB_LAZY_COALESCING
+#define BB_LAZY_COALESCING 0
+#endif
+/// @brief In lazy mode, number of uncoalesced blocks of an order above which
+/// they are all merged.
+#ifndef BB_LAZY_MAX_BLOCKS
+#define BB_LAZY_MAX_BLOCKS 32
+#endif
+
+/// @brief Number of pages each CPU keeps already filled with zeros.
+#ifndef BB_ZEROED_PAGES
+#define BB_ZEROED_PAGES 64
+#endif
+
+/// @brief Find the free order by probing the free lists one at a time, as
+/// before the free_orders mask, to compare the two through the fragmented
+/// workload of the zone benchmark (see ZONE_BENCHMARK).
+#ifndef BB_SCAN_FREE_LISTS
+#define BB_SCAN_FREE_LISTS 0
+#endif
+
+/// @brief Number of operations between two consistency checks of an instance,
+/// in debug mode (see BB_DEBUG).
+#ifndef BB_DEBUG_CHECK_INTERVAL
+#define BB_DEBUG_CHECK_INTERVAL 64
+#endif
+
+/// @brief Maximum number of pages moved at once between a cache and the buddy system.
+#define CACHE_BATCH_SIZE 32
+
+/// @brief Mobility class of the cached single pages, which are mostly short-lived.
+#define CACHE_MIGRATE_TYPE BB_MIGRATE_MOVABLE
+
+/// @brief Bit positions of the flags kept in the metadata byte of each page,
+/// whose lower bits hold the order of the block.
 enum bb_flag {
-    FREE_PAGE = 0, ///< Bit position that identifies when a page is free or not.
-    ROOT_PAGE = 1  ///< Bit position that identifies when a page is the root page.
+    FREE_PAGE = 4, ///< Bit position that identifies when a page is free or not.
+    ROOT_PAGE = 5, ///< Bit position that identifies when a page is the root page.
+    LAZY_PAGE = 6  ///< Bit position that identifies a free block waiting to be coalesced.
 };
 
+/// @brief Mask of the order inside the metadata byte of a page.
+#define ORDER_MASK 0x0F
+/// @brief Returns the mask of the given flag inside the metadata byte of a page.
+#define FLAG_MASK(flag) (1U << (flag))
+
+/// @brief Order of the pageblocks, the units of memory owned by a mobility class.
+#ifndef BB_PAGEBLOCK_ORDER
+#define BB_PAGEBLOCK_ORDER 9
+#endif
+
+#if BB_PAGEBLOCK_ORDER >= MAX_BUDDYSYSTEM_GFP_ORDER
+#error "BB_PAGEBLOCK_ORDER must be lower than MAX_BUDDYSYSTEM_GFP_ORDER"
+#endif
+
+/// @brief Largest order of the movable blocks that can be lent out of the
+/// region reserved to contiguous allocations.
+#ifndef BB_CMA_MAX_LEND_ORDER
+#define BB_CMA_MAX_LEND_ORDER 0
+#endif
+
+/// @brief Size of the pool from which the metadata table of each instance is
+/// taken, one byte for each managed page (1 MiB covers 4 GiB of memory).
+#ifndef BB_PAGE_INFO_POOL_SIZE
+#define BB_PAGE_INFO_POOL_SIZE (1UL << 20)
+#endif
+
+/// Pool holding the metadata tables of the instances.
+static uint8_t page_info_pool[BB_PAGE_INFO_POOL_SIZE];
+/// Number of bytes of the pool already given to an instance.
+static unsigned long page_info_pool_used = 0;
+
 /// @brief Sets the given flag in the page.
-/// @param page The page of which we want to modify the flag.
-/// @param flag The flag we want to set.
-static inline void __bb_set_flag(bb_page_t *page, int flag)
+/// @param instance The buddy system instance we are working with.
+/// @param index    The index of the page of which we want to modify the flag.
+/// @param flag     The flag we want to set.
+static inline void __bb_set_flag(bb_instance_t *instance, unsigned long index, int flag)
 {
-    set_bit(flag, &page->flags);
+    instance->page_info[index] |= FLAG_MASK(flag);
 }
 
 /// @brief Clears the given flag from the page.
-/// @param page The page of which we want to modify the flag.
-/// @param flag The flag we want to clear.
-static inline void __bb_clear_flag(bb_page_t *page, int flag)
+/// @param instance The buddy system instance we are working with.
+/// @param index    The index of the page of which we want to modify the flag.
+/// @param flag     The flag we want to clear.
+static inline void __bb_clear_flag(bb_instance_t *instance, unsigned long index, int flag)
 {
-    clear_bit(flag, &page->flags);
+    instance->page_info[index] &= ~FLAG_MASK(flag);
 }
 
 /// @brief Gets the given flag from the page.
-/// @param page The page of which we want to modify the flag.
-/// @param flag The flag we want to test.
+/// @param instance The buddy system instance we are working with.
+/// @param index    The index of the page of which we want to test the flag.
+/// @param flag     The flag we want to test.
 /// @return 1 if the bit is set, 0 otherwise.
-static inline int __bb_test_flag(bb_page_t *page, int flag)
+static inline int __bb_test_flag(bb_instance_t *instance, unsigned long index, int flag)
 {
-    return test_bit(flag, &page->flags);
+    return (instance->page_info[index] & FLAG_MASK(flag)) != 0;
+}
+
+/// @brief Returns the order of the block starting at the given page.
+/// @param instance The buddy system instance we are working with.
+/// @param index    The index of the page.
+/// @return The order of the block.
+static inline unsigned int __bb_get_order(bb_instance_t *instance, unsigned long index)
+{
+    return instance->page_info[index] & ORDER_MASK;
+}
+
+/// @brief Sets the order and all the flags of the page at once.
+/// @param instance The buddy system instance we are working with.
+/// @param index    The index of the page.
+/// @param order    The order of the block starting at the page.
+/// @param flags    The masks of the flags to set, all the others are cleared.
+static inline void __bb_set_info(bb_instance_t *instance, unsigned long index, unsigned int order, unsigned int flags)
+{
+    instance->page_info[index] = (uint8_t)(order | flags);
 }
 
 /// @brief Returns the page at the given index, starting from the given base.
@@ -83,6 +190,15 @@ static inline unsigned int __get_page_range(bb_instance_t *instance, bb_page_t *
     return (((uintptr_t)end) - ((uintptr_t)begin)) / instance->pgs_size;
 }
 
+/// @brief Returns the index of the given page, starting from the first page of the BB system.
+/// @param instance the buddy system instance we are working with.
+/// @param page     the page.
+/// @return The index of the page.
+static inline unsigned long __get_page_index(bb_instance_t *instance, bb_page_t *page)
+{
+    return __get_page_range(instance, instance->base_page, page);
+}
+
 /// @brief Get the buddy index of a page.
 /// @details
 ///  ----------------------- xor -----------------------
@@ -111,144 +227,877 @@ static inline bb_free_area_t *__get_area_of_order(bb_instance_t *instance, unsig
     return instance->free_area + order;
 }
 
-/// @brief Checks if the page is FREE and has the same order.
-/// @param page  the page to check.
-/// @param order the oder to check.
+/// @brief Checks if the page is the root of a FREE block with the same order.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the page to check.
+/// @param order    the oder to check.
 /// @return true if the page is buddy, false otherwise.
-static inline bool_t __page_is_buddy(bb_page_t *page, unsigned int order)
+static inline bool_t __page_is_buddy(bb_instance_t *instance, unsigned long index, unsigned int order)
 {
-    return __bb_test_flag(page, FREE_PAGE) && (page->order == order);
+    unsigned int mask = FLAG_MASK(FREE_PAGE) | FLAG_MASK(ROOT_PAGE) | ORDER_MASK;
+    return (instance->page_info[index] & mask) == (FLAG_MASK(FREE_PAGE) | FLAG_MASK(ROOT_PAGE) | order);
 }
 
-bb_page_t *bb_alloc_pages(bb_instance_t *instance, unsigned int order)
+/// @brief Returns the mobility class owning the pageblock of the given page.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the page.
+/// @return the mobility class.
+static inline unsigned int __get_block_type(bb_instance_t *instance, unsigned long index)
 {
-    bb_page_t *page      = NULL;
-    bb_free_area_t *area = NULL;
+    return instance->pageblock_type[index >> BB_PAGEBLOCK_ORDER];
+}
 
-    // Cyclic search through each list for an available block,
-    // starting with the list for the requested order and
-    // continuing if necessary to larger orders.
-    unsigned int current_order;
-    for (current_order = order; current_order < MAX_BUDDYSYSTEM_GFP_ORDER; current_order++){
-        area = __get_area_of_order(instance, current_order);
-        if(!list_head_empty(&area->free_list)){
-            goto block_found;
+/// @brief Gives all the pageblocks covered by a block to the given class.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the root page of the block.
+/// @param order    the order of the block.
+/// @param type     the new mobility class of the pageblocks.
+static inline void __set_block_type(bb_instance_t *instance, unsigned long index, unsigned int order, unsigned int type)
+{
+    unsigned long first = index >> BB_PAGEBLOCK_ORDER;
+    unsigned long last  = (index + (1UL << order) - 1) >> BB_PAGEBLOCK_ORDER;
+    for (unsigned long pageblock = first; pageblock <= last; pageblock++) {
+        instance->pageblock_type[pageblock] = type;
+    }
+}
+
+/// @brief Updates the bit of the given order in the non-empty orders mask of the class.
+/// @param instance the buddysystem instance.
+/// @param order    the order to update.
+/// @param type     the mobility class to update.
+static inline void __update_free_orders(bb_instance_t *instance, unsigned int order, unsigned int type)
+{
+    bb_free_area_t *area = __get_area_of_order(instance, order);
+    if (!list_head_empty(&area->free_list[type]) || !list_head_empty(&area->lazy_list[type])) {
+        instance->free_orders[type] |= (1UL << order);
+    } else {
+        instance->free_orders[type] &= ~(1UL << order);
+    }
+}
+
+/// @brief Inserts a free block at the head of the list of the given class, and
+/// marks the order as non-empty for that class.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the root page of the block.
+/// @param order    the order of the block.
+/// @param type     the mobility class of the block.
+/// @param lazy     if the block is waiting to be coalesced.
+static inline void __area_link_block(bb_instance_t *instance, unsigned long index, unsigned int order, unsigned int type, bool_t lazy)
+{
+    bb_free_area_t *area = __get_area_of_order(instance, order);
+    bb_page_t *page      = __get_page_at_index(instance, index);
+    if (lazy) {
+        __bb_set_info(instance, index, order, FLAG_MASK(FREE_PAGE) | FLAG_MASK(ROOT_PAGE) | FLAG_MASK(LAZY_PAGE));
+        list_head_insert_after(&page->location.siblings, &area->lazy_list[type]);
+        area->nr_lazy++;
+    } else {
+        __bb_set_info(instance, index, order, FLAG_MASK(FREE_PAGE) | FLAG_MASK(ROOT_PAGE));
+        list_head_insert_after(&page->location.siblings, &area->free_list[type]);
+        area->nr_free++;
+    }
+    instance->free_orders[type] |= (1UL << order);
+}
+
+/// @brief Removes a free block from the list of the given class, whether it is
+/// coalesced or not, and clears the order from the non-empty mask of the class
+/// when it has no more blocks.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the root page of the block.
+/// @param order    the order of the block.
+/// @param type     the mobility class of the block.
+static inline void __area_unlink_block(bb_instance_t *instance, unsigned long index, unsigned int order, unsigned int type)
+{
+    bb_free_area_t *area = __get_area_of_order(instance, order);
+    list_head_remove(&__get_page_at_index(instance, index)->location.siblings);
+    if (__bb_test_flag(instance, index, LAZY_PAGE)) {
+        __bb_clear_flag(instance, index, LAZY_PAGE);
+        area->nr_lazy--;
+    } else {
+        area->nr_free--;
+    }
+    __update_free_orders(instance, order, type);
+}
+
+/// @brief Adds a free block to the free-area of its order, in the list of the
+/// class owning its pageblock. A block larger than a pageblock gives all the
+/// pageblocks it covers to the class of the first one.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the root page of the block.
+/// @param order    the order of the block.
+/// @param lazy     if the block is waiting to be coalesced.
+static inline void __area_add_block(bb_instance_t *instance, unsigned long index, unsigned int order, bool_t lazy)
+{
+    unsigned int type = __get_block_type(instance, index);
+    if (order > BB_PAGEBLOCK_ORDER) {
+        __set_block_type(instance, index, order, type);
+    }
+    __area_link_block(instance, index, order, type, lazy);
+}
+
+/// @brief Marks the block as a free root of the given order and inserts it at
+/// the head of the free-area of that order.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the root page of the block.
+/// @param order    the order of the block.
+static inline void __area_insert_block(bb_instance_t *instance, unsigned long index, unsigned int order)
+{
+    __area_add_block(instance, index, order, false);
+}
+
+/// @brief Marks the block as a free root of the given order waiting to be
+/// coalesced, and inserts it at the head of the uncoalesced list of that order.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the root page of the block.
+/// @param order    the order of the block.
+static inline void __area_insert_lazy_block(bb_instance_t *instance, unsigned long index, unsigned int order)
+{
+    __area_add_block(instance, index, order, true);
+}
+
+/// @brief Removes a free block from the free-area of the given order.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the root page of the block.
+/// @param order    the order of the block.
+static inline void __area_remove_block(bb_instance_t *instance, unsigned long index, unsigned int order)
+{
+    __area_unlink_block(instance, index, order, __get_block_type(instance, index));
+}
+
+/// @brief Takes a free block of the given class out of the free-area of the
+/// given order, preferring the recently freed uncoalesced ones, which are still hot.
+/// @param instance the buddysystem instance.
+/// @param order    the order of the block, which must have free blocks of that class.
+/// @param type     the mobility class of the block.
+/// @return the index of the root page of the block.
+static inline unsigned long __area_pop_block(bb_instance_t *instance, unsigned int order, unsigned int type)
+{
+    bb_free_area_t *area = __get_area_of_order(instance, order);
+    list_head *list      = list_head_empty(&area->lazy_list[type]) ? &area->free_list[type] : &area->lazy_list[type];
+    unsigned long index  = __get_page_index(instance, list_entry(list->next, bb_page_t, location.siblings));
+    __area_unlink_block(instance, index, order, type);
+    return index;
+}
+
+/// @brief Finds the smallest order, greater or equal to the given one, which
+/// has at least one free block of the given class.
+/// @param instance the buddysystem instance.
+/// @param order    the minimum order we are looking for.
+/// @param type     the mobility class of the block.
+/// @return the order found, or -1 if there is no suitable free block.
+static inline int __find_free_order(bb_instance_t *instance, unsigned int order, unsigned int type)
+{
+#if BB_SCAN_FREE_LISTS
+    for (; order < MAX_BUDDYSYSTEM_GFP_ORDER; order++) {
+        bb_free_area_t *area = __get_area_of_order(instance, order);
+        if (!list_head_empty(&area->free_list[type]) || !list_head_empty(&area->lazy_list[type])) {
+            return order;
         }
     }
-    // No suitable free block has been found.
-    return NULL;
+    return -1;
+#else
+    // Discard all the orders below the requested one.
+    unsigned long mask = instance->free_orders[type] & ~((1UL << order) - 1);
+    if (mask == 0) {
+        return -1;
+    }
+    // The lowest set bit is the first non-empty order (bsf).
+    return __builtin_ctzl(mask);
+#endif
+}
+
+/// @brief The classes from which each class borrows the free blocks when its
+/// own lists are empty, in order of preference (BB_MIGRATE_TYPES ends the
+/// list). Only the movable pages borrow from the reserved region, and only
+/// when everything else is taken.
+static const uint8_t migrate_fallbacks[BB_MIGRATE_TYPES][BB_MIGRATE_TYPES - 1] = {
+    [BB_MIGRATE_UNMOVABLE]   = { BB_MIGRATE_RECLAIMABLE, BB_MIGRATE_MOVABLE, BB_MIGRATE_TYPES },
+    [BB_MIGRATE_RECLAIMABLE] = { BB_MIGRATE_UNMOVABLE, BB_MIGRATE_MOVABLE, BB_MIGRATE_TYPES },
+    [BB_MIGRATE_MOVABLE]     = { BB_MIGRATE_RECLAIMABLE, BB_MIGRATE_UNMOVABLE, BB_MIGRATE_CMA },
+    [BB_MIGRATE_CMA]         = { BB_MIGRATE_TYPES, BB_MIGRATE_TYPES, BB_MIGRATE_TYPES },
+};
+
+/// @brief Finds a free block of another class from which a block of the
+/// given order can be allocated. The largest blocks are preferred, so that
+/// the classes get mixed in as few pageblocks as possible.
+/// @param instance the buddysystem instance.
+/// @param order    the minimum order we are looking for.
+/// @param type     the mobility class of the allocation.
+/// @param fallback where the class of the block found is stored.
+/// @return the order found, or -1 if there is no suitable free block.
+static inline int __find_fallback_order(bb_instance_t *instance, unsigned int order, unsigned int type, unsigned int *fallback)
+{
+    for (int current = MAX_BUDDYSYSTEM_GFP_ORDER - 1; current >= (int)order; current--) {
+        for (unsigned int i = 0; i < (BB_MIGRATE_TYPES - 1); i++) {
+            unsigned int other = migrate_fallbacks[type][i];
+            if (other == BB_MIGRATE_TYPES) {
+                break;
+            }
+            // The reserved region only lends small blocks, which are easy to get back.
+            if ((other == BB_MIGRATE_CMA) && (order > BB_CMA_MAX_LEND_ORDER)) {
+                continue;
+            }
+            if (instance->free_orders[other] & (1UL << current)) {
+                *fallback = other;
+                return current;
+            }
+        }
+    }
+    return -1;
+}
 
-block_found:
+/// @brief Moves a free block to the lists of another class.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the root page of the block.
+/// @param order    the order of the block.
+/// @param type     the new mobility class of the block.
+static inline void __area_move_block(bb_instance_t *instance, unsigned long index, unsigned int order, unsigned int type)
+{
+    bool_t lazy = __bb_test_flag(instance, index, LAZY_PAGE);
+    __area_unlink_block(instance, index, order, __get_block_type(instance, index));
+    __area_link_block(instance, index, order, type, lazy);
+}
+
+/// @brief Called when a block, already out of the free lists, has been
+/// borrowed from another class. Blocks of at least a pageblock, and large or
+/// long-lived requests, take the whole pageblock with its free blocks, so
+/// that the next requests of the class are served from the same pageblock.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the root page of the block.
+/// @param order    the order of the block.
+/// @param type     the mobility class of the allocation.
+static void __steal_block(bb_instance_t *instance, unsigned long index, unsigned int order, unsigned int type)
+{
+    instance->stats.fallbacks++;
+    // The block is taken, it must not be moved with the free ones.
+    __bb_set_info(instance, index, order, FLAG_MASK(ROOT_PAGE));
+    if (order >= BB_PAGEBLOCK_ORDER) {
+        __set_block_type(instance, index, order, type);
+        return;
+    }
+    // Small movable allocations just borrow the block, they do not stay long.
+    if ((type == BB_MIGRATE_MOVABLE) && (order < (BB_PAGEBLOCK_ORDER / 2))) {
+        return;
+    }
+    // Move the free blocks of the pageblock to the lists of the class.
+    unsigned long start = index & ~((1UL << BB_PAGEBLOCK_ORDER) - 1);
+    unsigned long end   = start + (1UL << BB_PAGEBLOCK_ORDER);
+    if (end > instance->size) {
+        end = instance->size;
+    }
+    for (unsigned long current = start; current < end;) {
+        // The pageblock is smaller than the block, each page we reach is a root.
+        assert(__bb_test_flag(instance, current, ROOT_PAGE));
+        unsigned int block_order = __bb_get_order(instance, current);
+        if (__bb_test_flag(instance, current, FREE_PAGE)) {
+            __area_move_block(instance, current, block_order, type);
+        }
+        current += 1UL << block_order;
+    }
+    instance->pageblock_type[start >> BB_PAGEBLOCK_ORDER] = type;
+}
+
+static unsigned int __coalesce_lazy_blocks(bb_instance_t *instance);
+
+/// @brief Takes out of the free lists a block from which a block of the given
+/// order and class can be allocated. The lists of the class are tried first,
+/// merging the uncoalesced blocks when nothing large enough is left, and then
+/// the ones of the other classes.
+/// @param instance    the buddysystem instance.
+/// @param order       the minimum order we are looking for.
+/// @param type        the mobility class of the allocation.
+/// @param found_order where the order of the block is stored.
+/// @return the index of the root page of the block, or -1 if there is no suitable free block.
+static long __take_free_block(bb_instance_t *instance, unsigned int order, unsigned int type, unsigned int *found_order)
+{
+    int current = __find_free_order(instance, order, type);
+    if ((current < 0) && (__coalesce_lazy_blocks(instance) > 0)) {
+        // Merging the deferred blocks might have rebuilt a large enough block.
+        current = __find_free_order(instance, order, type);
+    }
+    if (current >= 0) {
+        *found_order = current;
+        return __area_pop_block(instance, current, type);
+    }
+    // Borrow a block from another class.
+    unsigned int fallback;
+    current = __find_fallback_order(instance, order, type, &fallback);
+    if (current < 0) {
+        return -1;
+    }
+    unsigned long index = __area_pop_block(instance, current, fallback);
+    if (fallback == BB_MIGRATE_CMA) {
+        // The reserved pageblocks never change class, the block is just lent.
+        __bb_set_info(instance, index, current, FLAG_MASK(ROOT_PAGE));
+        instance->stats.cma_lent++;
+    } else {
+        __steal_block(instance, index, current, type);
+    }
+    *found_order = current;
+    return index;
+}
+
+/// @brief Reads the lower half of the CPU time-stamp counter, which is enough
+/// to measure short intervals (the unsigned difference survives a wrap-around).
+/// N.B.: uint64_t is 32 bits wide in our libc, so we cannot use "=A" here.
+/// @return the lower 32 bits of the number of cycles since the CPU has been reset.
+static inline uint32_t __bb_rdtsc(void)
+{
+    uint32_t low;
+    __asm__ __volatile__("rdtsc"
+                         : "=a"(low)
+                         :
+                         : "edx");
+    return low;
+}
+
+/// @brief Returns the bucket of a duration in the log2 histograms, where
+/// bucket k counts the events that took [2^k, 2^(k+1)) cycles.
+/// @param cycles the duration.
+/// @return the index of the bucket.
+static inline unsigned int __stats_log2_bucket(uint32_t cycles)
+{
+    unsigned int bucket = 0;
+    if (cycles > 0) {
+        bucket = 31 - __builtin_clz(cycles);
+    }
+    if (bucket >= BB_LATENCY_BUCKETS) {
+        bucket = BB_LATENCY_BUCKETS - 1;
+    }
+    return bucket;
+}
+
+/// @brief Accounts for the duration of an allocation in the latency histogram.
+/// @param instance the buddysystem instance.
+/// @param cycles   the duration of the allocation.
+static inline void __stats_record_latency(bb_instance_t *instance, uint32_t cycles)
+{
+    instance->stats.alloc_latency[__stats_log2_bucket(cycles)]++;
+}
+
+/// @brief Takes the lock of the instance. Interrupts are disabled first, so
+/// that an interrupt handler allocating pages cannot deadlock against the
+/// code it interrupted.
+/// @param instance the buddysystem instance.
+/// @return the interrupt flags to restore when releasing the lock.
+static inline uint8_t __bb_lock(bb_instance_t *instance)
+{
+    uint8_t flags = irq_nested_disable();
+    // Try first, so that we only count the contended acquisitions.
+    if (!spinlock_trylock(&instance->lock)) {
+        spinlock_lock(&instance->lock);
+        instance->stats.lock_contentions++;
+    }
+    instance->stats.lock_acquisitions++;
+    instance->lock_start = __bb_rdtsc();
+    return flags;
+}
+
+/// @brief Releases the lock of the instance, accounting for the hold time.
+/// @param instance the buddysystem instance.
+/// @param flags    the interrupt flags returned by __bb_lock.
+static inline void __bb_unlock(bb_instance_t *instance, uint8_t flags)
+{
+    uint32_t held = __bb_rdtsc() - instance->lock_start;
+    instance->stats.lock_hold[__stats_log2_bucket(held)]++;
+    if (held > instance->stats.lock_max_hold) {
+        instance->stats.lock_max_hold = held;
+    }
+    spinlock_unlock(&instance->lock);
+    irq_nested_enable(flags);
+}
+
+/// @brief Checks the blocks of a free list.
+/// @param instance the buddysystem instance.
+/// @param list     the list.
+/// @param order    the order of the blocks of the list.
+/// @param type     the mobility class of the blocks of the list.
+/// @param lazy     if the blocks are waiting to be coalesced.
+/// @param errors   the number of inconsistencies found, updated.
+/// @return the number of blocks in the list.
+static unsigned long __check_free_list(bb_instance_t *instance, list_head *list, unsigned int order, unsigned int type, bool_t lazy, int *errors)
+{
+    unsigned int expected = FLAG_MASK(FREE_PAGE) | FLAG_MASK(ROOT_PAGE) | (lazy ? FLAG_MASK(LAZY_PAGE) : 0) | order;
+    unsigned long count   = 0;
+    list_for_each_decl(it, list)
+    {
+        unsigned long index = __get_page_index(instance, list_entry(it, bb_page_t, location.siblings));
+        // The rest of a broken list cannot be trusted.
+        if ((index >= instance->size) || (index & ((1UL << order) - 1)) || (count >= instance->size)) {
+            pr_err("%s: the order %u list of class %u is broken after %u blocks.\n", instance->name, order, type, count);
+            ++*errors;
+            break;
+        }
+        if (instance->page_info[index] != expected) {
+            pr_err("%s: block %u in the order %u list of class %u has info 0x%x instead of 0x%x.\n",
+                   instance->name, index, order, type, instance->page_info[index], expected);
+            ++*errors;
+        } else if (__get_block_type(instance, index) != type) {
+            pr_err("%s: block %u in the order %u list of class %u lies in a pageblock of class %u.\n",
+                   instance->name, index, order, type, __get_block_type(instance, index));
+            ++*errors;
+        }
+        ++count;
+    }
+    return count;
+}
+
+/// @brief Checks the consistency of the instance, see buddy_system_check.
+/// @param instance the buddysystem instance, whose lock must be held.
+/// @return the number of inconsistencies found.
+static int __check_instance(bb_instance_t *instance)
+{
+    int errors           = 0;
+    unsigned long listed = 0, roots = 0;
+    for (unsigned int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; order++) {
+        bb_free_area_t *area  = __get_area_of_order(instance, order);
+        unsigned long nr_free = 0, nr_lazy = 0;
+        for (unsigned int type = 0; type < BB_MIGRATE_TYPES; type++) {
+            unsigned long free = __check_free_list(instance, &area->free_list[type], order, type, false, &errors);
+            unsigned long lazy = __check_free_list(instance, &area->lazy_list[type], order, type, true, &errors);
+            if (((free + lazy) != 0) != ((instance->free_orders[type] >> order) & 1UL)) {
+                pr_err("%s: the order %u of class %u has %u blocks, but it is %s in the mask.\n",
+                       instance->name, order, type, free + lazy, (free + lazy) ? "empty" : "non-empty");
+                ++errors;
+            }
+            nr_free += free;
+            nr_lazy += lazy;
+        }
+        if ((nr_free != area->nr_free) || (nr_lazy != area->nr_lazy)) {
+            pr_err("%s: the order %u lists hold %u free and %u lazy blocks, but nr_free is %d and nr_lazy %d.\n",
+                   instance->name, order, nr_free, nr_lazy, area->nr_free, area->nr_lazy);
+            ++errors;
+        }
+        listed += nr_free + nr_lazy;
+    }
+    // Walk the blocks, every free root must be in a list.
+    for (unsigned long index = 0; index < instance->size; index += 1UL << __bb_get_order(instance, index)) {
+        if (!__bb_test_flag(instance, index, ROOT_PAGE)) {
+            pr_err("%s: page %u should be the root of a block.\n", instance->name, index);
+            ++errors;
+            break;
+        }
+        if (__bb_test_flag(instance, index, FREE_PAGE))
+            ++roots;
+    }
+    if (roots != listed) {
+        pr_err("%s: there are %u free blocks, but %u are listed.\n", instance->name, roots, listed);
+        ++errors;
+    }
+    // The cached pages are used single pages, for the buddy system.
+    for (unsigned int cpu = 0; cpu < BB_MAX_CPUS; ++cpu) {
+        bb_page_cache_t *cache = instance->cpu_cache + cpu;
+        list_head *lists[]     = { &cache->pages, &cache->zeroed };
+        for (unsigned int i = 0; i < 2; ++i) {
+            list_for_each_decl(it, lists[i])
+            {
+                unsigned long index = __get_page_index(instance, list_entry(it, bb_page_t, location.cache));
+                if ((index >= instance->size) || (instance->page_info[index] != FLAG_MASK(ROOT_PAGE))) {
+                    pr_err("%s: page %u in the cache of cpu %u is not a used single page.\n", instance->name, index, cpu);
+                    ++errors;
+                    break;
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+int buddy_system_check(bb_instance_t *instance)
+{
+    uint8_t flags = __bb_lock(instance);
+    int errors    = __check_instance(instance);
+    __bb_unlock(instance, flags);
+    return errors;
+}
+
+/// @brief Counts an operation on the instance, and checks its consistency
+/// every BB_DEBUG_CHECK_INTERVAL operations, in debug mode.
+/// @param instance the buddysystem instance, whose lock must be held.
+static inline void __debug_tick(bb_instance_t *instance)
+{
+#if BB_DEBUG
+    if (++instance->stats.debug_ops < BB_DEBUG_CHECK_INTERVAL)
+        return;
+    instance->stats.debug_ops = 0;
+    instance->stats.debug_checks++;
+    if (__check_instance(instance))
+        kernel_panic("The buddy system is corrupted!");
+#endif
+}
+
+/// @brief Records the call site of the allocation of the block, in debug mode.
+/// @param page the first page of the block, or NULL.
+/// @param site the address the allocation returns to.
+static inline void __debug_set_site(bb_page_t *page, void *site)
+{
+#if BB_DEBUG
+    if (page)
+        page->alloc_site = site;
+#endif
+}
+
+/// @brief Marks the block as used and returns its first page descriptor.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the root page of the block.
+/// @param order    the order of the block.
+/// @return the first page of the block.
+static inline bb_page_t *__mark_block_used(bb_instance_t *instance, unsigned long index, unsigned int order)
+{
+    __bb_set_info(instance, index, order, FLAG_MASK(ROOT_PAGE));
+    bb_page_t *page = __get_page_at_index(instance, index);
+    // The users of the block read its order from the page descriptor.
+    page->order = order;
+    return page;
+}
+
+/// @brief Takes a block of the given order and class from the free lists,
+/// splitting a larger one if needed.
+/// @param instance the buddysystem instance.
+/// @param order    the order of the block.
+/// @param type     the mobility class of the block.
+/// @return the first page of the block, or NULL if there is no free memory.
+static bb_page_t *__alloc_block(bb_instance_t *instance, unsigned int order, unsigned int type)
+{
+    unsigned int current_order;
+
+    // Look up the first non-empty list, starting with the list for the
+    // requested order and continuing if necessary to larger orders.
     // Get a block of pages from the found free_area_t. Here we have to manage
     // pages. Recall, free_area_t collects the first page_t of each free block
     // of 2^order contiguous page frames.
-    page = list_entry(area->free_list.next, bb_page_t, location.siblings);
-    //remove the page from the list of area's free pages
-    list_head_remove(&page->location.siblings);
-
-    //reduce the number of free blocks of the area
-    area->nr_free--;
-
-    //check that the page is actually a root one and free
-    assert(__bb_test_flag(page, FREE_PAGE) && __bb_test_flag(page, ROOT_PAGE));
+    //remove the page from the list of area's free pages, reducing the number of free blocks of the area
+    long found = __take_free_block(instance, order, type, &current_order);
+    if (found < 0) {
+        // No suitable free block has been found.
+        return NULL;
+    }
+    unsigned long page_idx = found;
 
-    //set the page as not free
-    __bb_clear_flag(page, FREE_PAGE);
+    //check that the page is actually a root one
+    assert(__bb_test_flag(instance, page_idx, ROOT_PAGE));
 
     //while we are above the order required, we take the buddy and put it in the lower area as free
-    unsigned long size = 1UL << current_order;
     while(current_order > order){
         //new order, we act on the lower order to insert the buddy
         current_order--; 
-        area = __get_area_of_order(instance, current_order);
 
-        //changed order, the size is halved
-        size = size/2;
-
-        //get the buddy, that is current_order pages after the root 
-        bb_page_t *buddy = __get_page_from_base(instance, page, size);
+        //get the buddy, that is the upper half of the block
+        unsigned long buddy_idx = page_idx + (1UL << current_order);
         
         //check that the buddy is a valid one
-        assert(__bb_test_flag(buddy, FREE_PAGE) && !__bb_test_flag(buddy, ROOT_PAGE));
+        assert(!__bb_test_flag(instance, buddy_idx, ROOT_PAGE));
 
         //set the buddy as correct order, as a root and add it to the current area's free list
-        buddy->order = current_order;
-        __bb_set_flag(buddy, ROOT_PAGE);
-        list_head_insert_after(&buddy->location.siblings, &area->free_list);
+        __area_insert_block(instance, buddy_idx, current_order);
+        instance->stats.splits++;
+    }
 
-        //increase the current area free blocks
-        area->nr_free++;
+    //set the page as not free and set its order
+    return __mark_block_used(instance, page_idx, order);
+}
+
+bb_page_t *bb_alloc_pages(bb_instance_t *instance, unsigned int order)
+{
+    // Kernel allocations do not move.
+    bb_page_t *page = bb_alloc_pages_type(instance, order, BB_MIGRATE_UNMOVABLE);
+    __debug_set_site(page, __builtin_return_address(0));
+    return page;
+}
 
+bb_page_t *bb_alloc_pages_type(bb_instance_t *instance, unsigned int order, bb_migrate_type_t type)
+{
+    if ((order >= MAX_BUDDYSYSTEM_GFP_ORDER) || (type >= BB_MIGRATE_CMA)) {
+        return NULL;
+    }
+    uint32_t start  = __bb_rdtsc();
+    uint8_t flags   = __bb_lock(instance);
+    bb_page_t *page = __alloc_block(instance, order, type);
+    __stats_record_latency(instance, __bb_rdtsc() - start);
+    if (page) {
+        instance->stats.allocs[order]++;
+    } else {
+        instance->stats.alloc_failures++;
     }
+    __debug_tick(instance);
+    __bb_unlock(instance, flags);
+    __debug_set_site(page, __builtin_return_address(0));
+    return page;
+}
 
-    //set the page order
-    page->order = order;
+/// @brief Merges a free block, which is not in any list, with its free
+/// buddies and inserts the result in the free lists.
+/// @param instance the buddysystem instance.
+/// @param page_idx the index of the first page of the block.
+/// @param order    the order of the block.
+static void __coalesce_block(bb_instance_t *instance, unsigned long page_idx, unsigned int order)
+{
+    while (order < MAX_BUDDYSYSTEM_GFP_ORDER -1){
 
-    return page;
+        //get buddy
+        unsigned long buddy_idx = __get_buddy_at_index(page_idx, order);
+
+        //if the buddy is past the end of the memory (the non-aligned tail has
+        //no buddy), or it is not free and/or not of the same order, stop
+        if((buddy_idx >= instance->size) || !__page_is_buddy(instance, buddy_idx, order)){
+            break;
+        }
+
+        //the reserved region is never merged with the memory around it
+        if((__get_block_type(instance, page_idx) == BB_MIGRATE_CMA) != (__get_block_type(instance, buddy_idx) == BB_MIGRATE_CMA)){
+            break;
+        }
+
+        //remove the buddy from the area, it might also be a block waiting to be coalesced
+        __area_remove_block(instance, buddy_idx, order);
+
+        //page and buddy are no longer roots, they are now inside the merged block
+        __bb_set_info(instance, buddy_idx, 0, 0);
+        __bb_set_info(instance, page_idx, 0, 0);
+
+        //page_idx becomes the lower address between the two
+        page_idx &= buddy_idx;
+
+        order++;
+        instance->stats.merges++;
+    }
+
+    //set the first page of the final block as free and root of its order, and
+    //insert it in the first position of the free list
+    __area_insert_block(instance, page_idx, order);
 }
 
-void bb_free_pages(bb_instance_t *instance, bb_page_t *page)
+/// @brief Merges all the uncoalesced blocks of the given order.
+/// @param instance the buddysystem instance.
+/// @param order    the order of the blocks.
+/// @return the number of blocks that were waiting to be coalesced.
+static unsigned int __coalesce_lazy_order(bb_instance_t *instance, unsigned int order)
 {
-    bb_free_area_t *area = NULL;
+    bb_free_area_t *area = __get_area_of_order(instance, order);
+    unsigned int count   = 0;
+    // Merging a block can also remove its buddy from these lists, so always
+    // restart from the head.
+    for (unsigned int type = 0; type < BB_MIGRATE_TYPES; type++) {
+        while (!list_head_empty(&area->lazy_list[type])) {
+            unsigned long index = __area_pop_block(instance, order, type);
+            __coalesce_block(instance, index, order);
+            count++;
+        }
+    }
+    return count;
+}
 
-    // Take the first page descriptor of the zone.
-    bb_page_t *base = instance->base_page;
-    // Take the page frame index of page compared to the zone.
-    unsigned long page_idx = __get_page_range(instance, base, page);
-    // Set the page freed, but do not set the private
-    // field because we want to try to merge. 
-    unsigned int order = page->order;
+/// @brief Merges all the uncoalesced blocks of the instance.
+/// @param instance the buddysystem instance.
+/// @return the number of blocks that were waiting to be coalesced.
+static unsigned int __coalesce_lazy_blocks(bb_instance_t *instance)
+{
+    unsigned int count = 0;
+    for (unsigned int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; order++) {
+        count += __coalesce_lazy_order(instance, order);
+    }
+    return count;
+}
 
+/// @brief Checks that we are freeing the root of a used block.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the first page of the block.
+static inline void __check_block_used(bb_instance_t *instance, unsigned long index)
+{
     // Check that the page is used, or that it is not a root page.
-    if (__bb_test_flag(page, FREE_PAGE) || !__bb_test_flag(page, ROOT_PAGE)) {
+    if (__bb_test_flag(instance, index, FREE_PAGE) || !__bb_test_flag(instance, index, ROOT_PAGE)) {
+#if BB_DEBUG
+        pr_err("%s: page %u freed twice, last allocated at %p.\n", instance->name, index,
+               __get_page_at_index(instance, index)->alloc_site);
+#endif
         kernel_panic("Double deallocation in buddy system!");
     }
+}
 
-    //mark as free
-    __bb_set_flag(page, FREE_PAGE);
+/// @brief Gives a used block back to the free lists. In eager mode the block
+/// is merged with its free buddies right away, in lazy mode it is kept at its
+/// order until too many blocks of that order are waiting.
+/// @param instance the buddysystem instance.
+/// @param index    the index of the first page of the block.
+/// @param order    the order of the block.
+static void __free_block(bb_instance_t *instance, unsigned long index, unsigned int order)
+{
+    if (!instance->lazy_coalescing) {
+        __coalesce_block(instance, index, order);
+        return;
+    }
+    __area_insert_lazy_block(instance, index, order);
+    if (__get_area_of_order(instance, order)->nr_lazy > BB_LAZY_MAX_BLOCKS) {
+        __coalesce_lazy_order(instance, order);
+    }
+}
 
-    while (order < MAX_BUDDYSYSTEM_GFP_ORDER -1){
+void buddy_system_set_lazy_coalescing(bb_instance_t *instance, bool_t enable)
+{
+    uint8_t flags             = __bb_lock(instance);
+    instance->lazy_coalescing = enable;
+    if (!enable) {
+        // Go back to a fully coalesced state.
+        __coalesce_lazy_blocks(instance);
+    }
+    __bb_unlock(instance, flags);
+}
 
-        //get area in which we operate
-        area = __get_area_of_order(instance, order);
+void bb_free_pages(bb_instance_t *instance, bb_page_t *page)
+{
+    // Take the page frame index of page compared to the zone.
+    unsigned long page_idx = __get_page_index(instance, page);
+    uint8_t flags          = __bb_lock(instance);
+    __check_block_used(instance, page_idx);
+    unsigned int order = __bb_get_order(instance, page_idx);
+    instance->stats.frees[order]++;
+    __free_block(instance, page_idx, order);
+    __debug_tick(instance);
+    __bb_unlock(instance, flags);
+}
 
-        //get new page because we could have a new address in case the buddy is on the lower adddresses
-        page = __get_page_from_base(instance, base, page_idx);
+void bb_split_pages(bb_instance_t *instance, bb_page_t *page)
+{
+    unsigned long page_idx = __get_page_index(instance, page);
+    uint8_t flags          = __bb_lock(instance);
+    // Only the first page of a used block can be split.
+    if (__bb_test_flag(instance, page_idx, FREE_PAGE) || !__bb_test_flag(instance, page_idx, ROOT_PAGE)) {
+        __bb_unlock(instance, flags);
+        return;
+    }
+    unsigned int order = __bb_get_order(instance, page_idx);
+    for (unsigned long i = 0; i < (1UL << order); i++) {
+        __mark_block_used(instance, page_idx + i, 0);
+#if BB_DEBUG
+        __debug_set_site(__get_page_at_index(instance, page_idx + i), page->alloc_site);
+#endif
+    }
+    // The pages are going to be freed one by one.
+    instance->stats.allocs[order]--;
+    instance->stats.allocs[0] += 1UL << order;
+    __debug_tick(instance);
+    __bb_unlock(instance, flags);
+}
 
-        //get buddy
-        unsigned long buddy_idx = __get_buddy_at_index(page_idx, order);
-        bb_page_t *buddy = __get_page_from_base(instance, base, buddy_idx);
+unsigned int bb_alloc_pages_bulk(bb_instance_t *instance, unsigned int order, bb_migrate_type_t type, unsigned int count, bb_page_t **pages)
+{
+    unsigned int allocated = 0;
 
-        //if the page is not a buddy (not free and/or not of the same order), stop
-        if(!__page_is_buddy(buddy, order)){
+    if ((order >= MAX_BUDDYSYSTEM_GFP_ORDER) || (type >= BB_MIGRATE_CMA)) {
+        return 0;
+    }
+
+    uint8_t flags = __bb_lock(instance);
+    while (allocated < count) {
+        // Look up the first block large enough to serve the request.
+        unsigned int found_order;
+        long found = __take_free_block(instance, order, type, &found_order);
+        if (found < 0) {
+            // We ran out of memory, return what we got so far.
             break;
         }
+        unsigned long block_idx = found;
 
-        //remove the buddy from the area
-        list_head_remove(&buddy->location.siblings);
-        area->nr_free--;
+        //number of blocks of the requested order contained in the one we found
+        unsigned long available = 1UL << (found_order - order);
+        unsigned long taken     = count - allocated;
+        if (taken > available) {
+            taken = available;
+        }
 
-        //clear page and buddy root flag
-        __bb_clear_flag(buddy, ROOT_PAGE);
-        __bb_clear_flag(page, ROOT_PAGE);
+        //hand out the first blocks, each one as a used root of the requested order
+        for (unsigned long i = 0; i < taken; i++) {
+            pages[allocated++] = __mark_block_used(instance, block_idx + (i << order), order);
+        }
 
-        //page_idx becomes the lower address between the two
-        page_idx &= buddy_idx;
+        //give back what is left as the largest aligned blocks that fit, which
+        //is what splitting the block one order at a time would leave behind
+        unsigned long offset = taken << order;
+        unsigned long end    = 1UL << found_order;
+        unsigned long pieces = taken;
+        while (offset < end) {
+            unsigned int rest_order = __builtin_ctzl(offset);
+            __area_insert_block(instance, block_idx + offset, rest_order);
+            offset += 1UL << rest_order;
+            pieces++;
+        }
+        //cutting a block in n pieces takes n - 1 splits
+        instance->stats.splits += pieces - 1;
+    }
+    instance->stats.allocs[order] += allocated;
+    if (allocated < count) {
+        instance->stats.alloc_failures++;
+    }
+    __debug_tick(instance);
+    __bb_unlock(instance, flags);
+    for (unsigned int i = 0; i < allocated; i++) {
+        __debug_set_site(pages[i], __builtin_return_address(0));
+    }
+    return allocated;
+}
 
-        order++;
+void bb_free_pages_bulk(bb_instance_t *instance, bb_page_t **pages, unsigned int count)
+{
+    // Sort the blocks by address, that is by page index (insertion sort, the
+    // batches coming from the cache are small).
+    for (unsigned int i = 1; i < count; i++) {
+        bb_page_t *page = pages[i];
+        unsigned int j  = i;
+        for (; (j > 0) && (pages[j - 1] > page); j--) {
+            pages[j] = pages[j - 1];
+        }
+        pages[j] = page;
+    }
+    // A block freed twice in the batch ends up next to its copy, and it would
+    // pass the checks below as both copies are still used.
+    for (unsigned int i = 1; i < count; i++) {
+        if (pages[i] == pages[i - 1]) {
+            kernel_panic("Double deallocation in buddy system!");
+        }
     }
 
-    //get the final block and set the first page as free and root
-    page = __get_page_from_base(instance, base, page_idx);
-    __bb_set_flag(page, ROOT_PAGE);
+    // Merge adjacent buddies inside the batch, using the array itself as a
+    // stack: when the two blocks on top are buddies they become one block of
+    // the next order, which might in turn be merged with the one below it.
+    // N.B.: The sort does not touch the buddy system, only this part needs the lock.
+    uint8_t flags    = __bb_lock(instance);
+    unsigned int top = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned long page_idx = __get_page_index(instance, pages[i]);
+        __check_block_used(instance, page_idx);
+        instance->stats.frees[__bb_get_order(instance, page_idx)]++;
 
-    //set page order
-    page->order = order;
+        pages[top++] = pages[i];
+        while (top >= 2) {
+            unsigned long l_idx = __get_page_index(instance, pages[top - 2]);
+            unsigned long r_idx = __get_page_index(instance, pages[top - 1]);
+            unsigned int order  = __bb_get_order(instance, l_idx);
+
+            //the two blocks must have the same order, and the right one must be the buddy of the left one
+            if ((__bb_get_order(instance, r_idx) != order) || (order >= MAX_BUDDYSYSTEM_GFP_ORDER - 1) ||
+                (l_idx & (1UL << order)) || (__get_buddy_at_index(l_idx, order) != r_idx)) {
+                break;
+            }
+
+            //the reserved region is never merged with the memory around it
+            if ((__get_block_type(instance, l_idx) == BB_MIGRATE_CMA) != (__get_block_type(instance, r_idx) == BB_MIGRATE_CMA)) {
+                break;
+            }
 
-    //insert in the first position of the free list
-    area = __get_area_of_order(instance, order);
-    list_head_insert_after(&page->location.siblings, &area->free_list);
+            //the right block becomes part of the left one
+            __bb_set_info(instance, r_idx, 0, 0);
+            __bb_set_info(instance, l_idx, order + 1, FLAG_MASK(ROOT_PAGE));
+            top--;
+            instance->stats.merges++;
+        }
+    }
 
+    // Release the merged blocks, which are then coalesced with the free lists.
+    for (unsigned int i = 0; i < top; i++) {
+        unsigned long page_idx = __get_page_index(instance, pages[i]);
+        __free_block(instance, page_idx, __bb_get_order(instance, page_idx));
+    }
+    __debug_tick(instance);
+    __bb_unlock(instance, flags);
 }
 
 void buddy_system_init(bb_instance_t *instance,
@@ -257,6 +1106,17 @@ void buddy_system_init(bb_instance_t *instance,
                        uint32_t bbpage_offset,
                        uint32_t pages_stride,
                        uint32_t pages_count)
+{
+    buddy_system_init_reserved(instance, name, pages_start, bbpage_offset, pages_stride, pages_count, 0);
+}
+
+void buddy_system_init_reserved(bb_instance_t *instance,
+                                const char *name,
+                                void *pages_start,
+                                uint32_t bbpage_offset,
+                                uint32_t pages_stride,
+                                uint32_t pages_count,
+                                uint32_t reserved_count)
 {
     // Compute the base base page of the buddysystem instance.
     instance->base_page = ((bb_page_t *)(((uint32_t)pages_start) + bbpage_offset));
@@ -265,19 +1125,43 @@ void buddy_system_init(bb_instance_t *instance,
     instance->pgs_size    = pages_stride;
     instance->size        = pages_count;
     instance->name        = name;
+    // Initialize the lock.
+    spinlock_init(&instance->lock);
+    instance->lock_start = 0;
+
+    // Number of pageblocks, the last one might be partial.
+    uint32_t pageblocks_count = (pages_count + (1UL << BB_PAGEBLOCK_ORDER) - 1) >> BB_PAGEBLOCK_ORDER;
 
-    // Initialize all pages.
-    for (uint32_t index = 0; index < pages_count; ++index) {
-        // Get the page at the given index.
-        bb_page_t *page = __get_page_at_index(instance, index);
-        // Initialize the flags of the page.
-        page->flags = 0;
-        // Mark page as free.
-        __bb_set_flag(page, FREE_PAGE);
-        // Initialize siblings list.
-        list_head_init(&(page->location.siblings));
-        // N.B.: The order is initialized afterwards.
+    // Take the metadata tables of the pages and of the pageblocks from the pool.
+    if ((page_info_pool_used + pages_count + pageblocks_count) > BB_PAGE_INFO_POOL_SIZE) {
+        kernel_panic("The buddy system page info pool is too small!");
     }
+    instance->page_info = page_info_pool + page_info_pool_used;
+    page_info_pool_used += pages_count;
+    instance->pageblock_type = page_info_pool + page_info_pool_used;
+    page_info_pool_used += pageblocks_count;
+    // Initially no page is the root of a block.
+    memset(instance->page_info, 0, pages_count);
+    // Initially all the memory is movable, the other classes take pageblocks from it.
+    memset(instance->pageblock_type, BB_MIGRATE_MOVABLE, pageblocks_count);
+
+    // The reserved region is made of the last whole pageblocks, so that it is
+    // far from the early kernel allocations, and it cannot take more than a
+    // quarter of the memory. It runs to the end of the memory, so it also
+    // takes the partial pageblock at the end, if there is one.
+    uint32_t reserved_pageblocks = reserved_count >> BB_PAGEBLOCK_ORDER;
+    if (reserved_pageblocks > ((pages_count >> BB_PAGEBLOCK_ORDER) / 4)) {
+        reserved_pageblocks = (pages_count >> BB_PAGEBLOCK_ORDER) / 4;
+    }
+    instance->cma_start = pages_count;
+    if (reserved_pageblocks > 0) {
+        uint32_t cma_pageblock = (pages_count >> BB_PAGEBLOCK_ORDER) - reserved_pageblocks;
+        instance->cma_start    = cma_pageblock << BB_PAGEBLOCK_ORDER;
+        memset(instance->pageblock_type + cma_pageblock, BB_MIGRATE_CMA, pageblocks_count - cma_pageblock);
+    }
+
+    // N.B.: The page descriptors are not touched here, only the roots of the
+    // free blocks are initialized when they are inserted in the free lists.
 
     // Initialize the free_lists of each area of the zone.
     for (unsigned int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; order++) {
@@ -285,35 +1169,96 @@ void buddy_system_init(bb_instance_t *instance,
         bb_free_area_t *area = __get_area_of_order(instance, order);
         // Initialize the number of free pages.
         area->nr_free = 0;
-        // Initialize linked list of free pages.
-        list_head_init(&area->free_list);
+        // Initialize the number of blocks waiting to be coalesced.
+        area->nr_lazy = 0;
+        for (unsigned int type = 0; type < BB_MIGRATE_TYPES; type++) {
+            // Initialize linked list of free pages.
+            list_head_init(&area->free_list[type]);
+            // Initialize the list of the blocks waiting to be coalesced.
+            list_head_init(&area->lazy_list[type]);
+        }
+    }
+    // Set the default coalescing mode.
+    instance->lazy_coalescing = BB_LAZY_COALESCING;
+    // Initially, no order has free blocks.
+    memset(instance->free_orders, 0, sizeof(instance->free_orders));
+
+    // Reset the statistics.
+    memset(&instance->stats, 0, sizeof(bb_stats_t));
+
+    // Initialize the page cache of each CPU.
+    for (unsigned int cpu = 0; cpu < BB_MAX_CPUS; ++cpu) {
+        bb_page_cache_t *cache = instance->cpu_cache + cpu;
+        list_head_init(&cache->pages);
+        cache->size           = 0;
+        cache->low_watermark  = LOW_WATERMARK_LEVEL;
+        cache->mid_watermark  = MID_WATERMARK_LEVEL;
+        cache->high_watermark = HIGH_WATERMARK_LEVEL;
+        cache->rate           = MID_WATERMARK_LEVEL;
+        cache->ops            = 0;
+        cache->sample_start   = 0;
+        list_head_init(&cache->zeroed);
+        cache->zeroed_size = 0;
     }
 
-    // Current base page descriptor of the zone.
-    bb_page_t *page = instance->base_page;
-    // Address of the last page descriptor of the zone.
-    bb_page_t *last_page = __get_page_from_base(instance, page, instance->size);
-    // Initially, all the memory is divided into blocks of the higher order.
+    // Divide the memory in the largest aligned blocks that fit: blocks of the
+    // highest order first, then the non-aligned tail goes to the lower orders.
+    // The reserved region is divided on its own.
     const unsigned int max_order = MAX_BUDDYSYSTEM_GFP_ORDER - 1;
-    // Get the free area collecting the larges block of page frames.
-    bb_free_area_t *area = __get_area_of_order(instance, max_order);
-    // Compute the block size.
-    uint32_t block_size = 1UL << max_order;
-    // Add all zone's pages to the largest free area block.
-    while ((page + block_size) <= last_page) {
-        // Save the order of the page.
-        page->order = max_order;
-        // Set the page as root.
-        __bb_set_flag(page, ROOT_PAGE);
-        // Insert the page inside the list of free pages of the area.
-        list_head_insert_before(&page->location.siblings, &area->free_list);
+    unsigned long index          = 0;
+    while (index < pages_count) {
+        unsigned long limit = (index < instance->cma_start) ? instance->cma_start : pages_count;
+        unsigned int type   = __get_block_type(instance, index);
+        // The block must be aligned to its size...
+        unsigned int order = (index == 0) ? max_order : __builtin_ctzl(index);
+        if (order > max_order) {
+            order = max_order;
+        }
+        // ...and it must fit in the remaining pages.
+        while ((index + (1UL << order)) > limit) {
+            order--;
+        }
+        // Get the free area collecting the blocks of the given order.
+        bb_free_area_t *area = __get_area_of_order(instance, order);
+        // Set the page as the free root of the block.
+        __bb_set_info(instance, index, order, FLAG_MASK(FREE_PAGE) | FLAG_MASK(ROOT_PAGE));
+        // Insert the page at the end of the list, the lower addresses come first.
+        list_head_insert_before(&__get_page_at_index(instance, index)->location.siblings, &area->free_list[type]);
         // Increase the number of free block of the area.
         area->nr_free++;
-        // Move to the next page.
-        page = __get_page_from_base(instance, page, block_size);
+        // Mark the order as non-empty.
+        instance->free_orders[type] |= (1UL << order);
+        // Move to the next block.
+        index += 1UL << order;
+    }
+}
+
+/// @brief Computes the fragmentation index of the given order, which tells why
+/// an allocation of that order would fail: values towards 0 mean that there is
+/// not enough free memory, values towards 1000 that the free memory is too
+/// fragmented.
+/// @param instance the buddysystem instance.
+/// @param order    the order of the allocation.
+/// @return the index in thousandths, or -1000 if the allocation would succeed.
+static int __fragmentation_index(bb_instance_t *instance, unsigned int order)
+{
+    unsigned long free_pages = 0, free_blocks = 0, suitable_blocks = 0;
+    for (unsigned int current = 0; current < MAX_BUDDYSYSTEM_GFP_ORDER; current++) {
+        bb_free_area_t *area = __get_area_of_order(instance, current);
+        unsigned long blocks = area->nr_free + area->nr_lazy;
+        free_blocks += blocks;
+        free_pages += blocks << current;
+        if (current >= order) {
+            suitable_blocks += blocks;
+        }
     }
-    // Check that the page we have reached with the iteration is the last page.
-    assert(page == last_page && "Memory size is not aligned to MAX_ORDER size!");
+    if (free_blocks == 0) {
+        return 0;
+    }
+    if (suitable_blocks > 0) {
+        return -1000;
+    }
+    return 1000 - (int)((1000 + ((free_pages * 1000) >> order)) / free_blocks);
 }
 
 void buddy_system_dump(bb_instance_t *instance)
@@ -325,6 +1270,111 @@ void buddy_system_dump(bb_instance_t *instance)
         pr_debug("%2d ", area->nr_free);
     }
     pr_debug(": %s\n", to_human_size(buddy_system_get_free_space(instance)));
+    // Print the blocks waiting to be coalesced.
+    if (instance->lazy_coalescing) {
+        pr_debug("     %-12s ", "(lazy)");
+        for (int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; order++) {
+            pr_debug("%2d ", instance->free_area[order].nr_lazy);
+        }
+        pr_debug("\n");
+    }
+    // Print the fragmentation index of each order, in thousandths.
+    pr_debug("     %-12s ", "(fragidx)");
+    for (int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; order++) {
+        pr_debug("%d ", __fragmentation_index(instance, order));
+    }
+    pr_debug("\n");
+    // Print how many pageblocks each mobility class owns.
+    unsigned long pageblocks[BB_MIGRATE_TYPES] = { 0 };
+    for (unsigned long pageblock = 0; (pageblock << BB_PAGEBLOCK_ORDER) < instance->size; pageblock++) {
+        pageblocks[instance->pageblock_type[pageblock]]++;
+    }
+    pr_debug("    pageblocks: %u unmovable, %u reclaimable, %u movable, %u reserved\n",
+             pageblocks[BB_MIGRATE_UNMOVABLE], pageblocks[BB_MIGRATE_RECLAIMABLE], pageblocks[BB_MIGRATE_MOVABLE],
+             pageblocks[BB_MIGRATE_CMA]);
+    // Print the current watermark band of each page cache.
+    for (unsigned int cpu = 0; cpu < BB_MAX_CPUS; ++cpu) {
+        bb_page_cache_t *cache = instance->cpu_cache + cpu;
+        pr_debug("    cpu %u cache: %4u pages (low %u, mid %u, high %u, rate %u), %u zeroed\n",
+                 cpu, cache->size, cache->low_watermark, cache->mid_watermark,
+                 cache->high_watermark, cache->rate, cache->zeroed_size);
+    }
+}
+
+/// @brief Appends a formatted line to the buffer, if it fits.
+/// @param buffer  the buffer we are writing.
+/// @param bufsize the size of the buffer.
+/// @param length  the current length of the content of the buffer, updated.
+/// @param format  the format of the line.
+static void __stats_append(char *buffer, size_t bufsize, size_t *length, const char *format, ...)
+{
+    char line[128];
+    va_list args;
+    va_start(args, format);
+    size_t line_length = vsprintf(line, format, args);
+    va_end(args);
+    if ((*length + line_length + 1) <= bufsize) {
+        memcpy(buffer + *length, line, line_length + 1);
+        *length += line_length;
+    }
+}
+
+size_t buddy_system_read_stats(bb_instance_t *instance, char *buffer, size_t bufsize)
+{
+    bb_stats_t snapshot, *stats = &snapshot;
+    int nr_free[MAX_BUDDYSYSTEM_GFP_ORDER], nr_lazy[MAX_BUDDYSYSTEM_GFP_ORDER];
+    int fragidx[MAX_BUDDYSYSTEM_GFP_ORDER];
+    size_t length = 0;
+
+    // Take a consistent snapshot, and format it without holding the lock.
+    uint8_t flags = __bb_lock(instance);
+    snapshot      = instance->stats;
+    for (unsigned int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; order++) {
+        nr_free[order] = instance->free_area[order].nr_free;
+        nr_lazy[order] = instance->free_area[order].nr_lazy;
+        fragidx[order] = __fragmentation_index(instance, order);
+    }
+    __bb_unlock(instance, flags);
+
+    __stats_append(buffer, bufsize, &length, "zone %s\n", instance->name);
+    __stats_append(buffer, bufsize, &length, "order   nr_free   nr_lazy    allocs     frees\n");
+    for (unsigned int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; order++) {
+        __stats_append(buffer, bufsize, &length, "%5u %9d %9d %9u %9u\n", order,
+                       nr_free[order], nr_lazy[order], stats->allocs[order], stats->frees[order]);
+    }
+    __stats_append(buffer, bufsize, &length, "fragidx_permille");
+    for (unsigned int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; order++) {
+        __stats_append(buffer, bufsize, &length, " %d", fragidx[order]);
+    }
+    __stats_append(buffer, bufsize, &length, "\n");
+    __stats_append(buffer, bufsize, &length, "alloc_failures %u\n", stats->alloc_failures);
+    __stats_append(buffer, bufsize, &length, "fallbacks %u\n", stats->fallbacks);
+    __stats_append(buffer, bufsize, &length, "splits %u\nmerges %u\n", stats->splits, stats->merges);
+    __stats_append(buffer, bufsize, &length, "cache_hits %u\ncache_misses %u\n", stats->cache_hits, stats->cache_misses);
+    __stats_append(buffer, bufsize, &length, "cache_refills %u\ncache_drains %u\n", stats->cache_refills, stats->cache_drains);
+    __stats_append(buffer, bufsize, &length, "zeroed_hits %u\nzeroed_misses %u\n", stats->zeroed_hits, stats->zeroed_misses);
+    __stats_append(buffer, bufsize, &length, "zeroed_pages %u\nzero_cycles_per_page %u\n", stats->zeroed_pages,
+                   stats->zeroed_pages ? (stats->zero_cycles / stats->zeroed_pages) : 0);
+    __stats_append(buffer, bufsize, &length, "cma_pages %u\ncma_lent %u\ncma_reclaimed %u\n",
+                   instance->size - instance->cma_start, stats->cma_lent, stats->cma_reclaimed);
+    __stats_append(buffer, bufsize, &length, "contig_allocs %u\ncontig_failures %u\n", stats->contig_allocs, stats->contig_failures);
+#if BB_DEBUG
+    __stats_append(buffer, bufsize, &length, "debug_checks %u\n", stats->debug_checks);
+#endif
+    __stats_append(buffer, bufsize, &length, "alloc_latency_log2_cycles");
+    for (unsigned int bucket = 0; bucket < BB_LATENCY_BUCKETS; bucket++) {
+        __stats_append(buffer, bufsize, &length, " %u", stats->alloc_latency[bucket]);
+    }
+    __stats_append(buffer, bufsize, &length, "\n");
+    __stats_append(buffer, bufsize, &length, "lock_acquisitions %u\nlock_contentions %u\n",
+                   stats->lock_acquisitions, stats->lock_contentions);
+    __stats_append(buffer, bufsize, &length, "lock_max_hold_cycles %u\n", stats->lock_max_hold);
+    __stats_append(buffer, bufsize, &length, "lock_hold_log2_cycles");
+    for (unsigned int bucket = 0; bucket < BB_LATENCY_BUCKETS; bucket++) {
+        __stats_append(buffer, bufsize, &length, " %u", stats->lock_hold[bucket]);
+    }
+    __stats_append(buffer, bufsize, &length, "\n");
+    return length;
 }
 
 unsigned long buddy_system_get_total_space(bb_instance_t *instance)
@@ -336,58 +1386,152 @@ unsigned long buddy_system_get_free_space(bb_instance_t *instance)
 {
     unsigned int size = 0;
     for (int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; ++order)
-        size += instance->free_area[order].nr_free * (1UL << order) * PAGE_SIZE;
+        size += (instance->free_area[order].nr_free + instance->free_area[order].nr_lazy) * (1UL << order) * PAGE_SIZE;
     return size;
 }
 
 unsigned long buddy_system_get_cached_space(bb_instance_t *instance)
 {
     unsigned int size = 0;
-    for (int order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; ++order)
-        size += instance->free_pages_cache_size * PAGE_SIZE;
+    for (unsigned int cpu = 0; cpu < BB_MAX_CPUS; ++cpu)
+        size += (instance->cpu_cache[cpu].size + instance->cpu_cache[cpu].zeroed_size) * PAGE_SIZE;
     return size;
 }
 
-static void __cache_extend(bb_instance_t *instance, int count)
+/// @brief Returns the page cache of the CPU we are running on.
+/// @param instance the buddysystem instance.
+/// @return pointer to the page cache.
+static inline bb_page_cache_t *__get_cpu_cache(bb_instance_t *instance)
+{
+    return instance->cpu_cache + bb_current_cpu();
+}
+
+/// @brief Refills the cache with single pages taken from the buddy system.
+/// @param instance the buddysystem instance.
+/// @param cache    the cache to refill.
+/// @param count    the number of pages to add.
+static void __cache_extend(bb_instance_t *instance, bb_page_cache_t *cache, unsigned long count)
+{
+    bb_page_t *batch[CACHE_BATCH_SIZE];
+    while (count > 0) {
+        unsigned int requested = (count < CACHE_BATCH_SIZE) ? count : CACHE_BATCH_SIZE;
+        unsigned int obtained  = bb_alloc_pages_bulk(instance, 0, CACHE_MIGRATE_TYPE, requested, batch);
+        for (unsigned int i = 0; i < obtained; i++) {
+            // Fresh pages are cold, queue them behind the recently freed ones.
+            list_head_insert_before(&batch[i]->location.cache, &cache->pages);
+        }
+        cache->size += obtained;
+        // The buddy system is out of memory, keep what we got so far.
+        if (obtained < requested)
+            break;
+        count -= obtained;
+    }
+}
+
+/// @brief Gives back single pages from the cache to the buddy system.
+/// @param instance the buddysystem instance.
+/// @param cache    the cache to drain.
+/// @param count    the number of pages to release.
+static void __cache_shrink(bb_instance_t *instance, bb_page_cache_t *cache, unsigned long count)
 {
-    for (int i = 0; i < count; i++) {
-        bb_page_t *page = bb_alloc_pages(instance, 0);
-        list_head_insert_after(&page->location.cache, &instance->free_pages_cache_list);
-        instance->free_pages_cache_size++;
+    bb_page_t *batch[CACHE_BATCH_SIZE];
+    while ((count > 0) && !list_head_empty(&cache->pages)) {
+        unsigned int collected = 0;
+        while ((collected < count) && (collected < CACHE_BATCH_SIZE) && !list_head_empty(&cache->pages)) {
+            // Release the coldest pages, which are at the tail of the list.
+            list_head *page_list = cache->pages.prev;
+            list_head_remove(page_list);
+            batch[collected++] = list_entry(page_list, bb_page_t, location.cache);
+        }
+        bb_free_pages_bulk(instance, batch, collected);
+        cache->size -= collected;
+        count -= collected;
     }
 }
 
-static void __cache_shrink(bb_instance_t *instance, int count)
+/// @brief Resizes the watermark band of the cache around the given midway
+/// limit, keeping the same proportions of the initial band (10/40/70).
+/// @param cache the cache to resize.
+/// @param mid   the new midway limit.
+static inline void __cache_set_band(bb_page_cache_t *cache, unsigned long mid)
 {
-    for (int i = 0; i < count; i++) {
-        list_head *page_list = list_head_pop(&instance->free_pages_cache_list);
-        bb_page_t *page      = list_entry(page_list, bb_page_t, location.cache);
-        bb_free_pages(instance, page);
-        instance->free_pages_cache_size--;
+    if (mid < CACHE_MIN_MID_LEVEL)
+        mid = CACHE_MIN_MID_LEVEL;
+    if (mid > CACHE_MAX_MID_LEVEL)
+        mid = CACHE_MAX_MID_LEVEL;
+    cache->mid_watermark  = mid;
+    cache->low_watermark  = mid / 4;
+    cache->high_watermark = (mid * 7) / 4;
+}
+
+/// @brief Accounts for an alloc/free operation on the cache and, once per
+/// sampling period, updates the moving average of the operations rate and
+/// resizes the watermark band accordingly: bursts widen it so that refills
+/// and drains move larger batches less often, idle periods make it decay so
+/// that the cache holds less memory.
+/// @param cache the cache we are working with.
+static inline void __cache_account(bb_page_cache_t *cache)
+{
+    unsigned long now     = timer_get_ticks();
+    unsigned long periods = (now - cache->sample_start) / CACHE_SAMPLE_TICKS;
+    if (periods == 0) {
+        cache->ops++;
+        return;
     }
+    if (periods > CACHE_MAX_IDLE_PERIODS) {
+        // After a long idle time the past activity does not matter anymore.
+        cache->rate = 0;
+    } else {
+        // Exponential moving average with a weight of 1/4 for the new sample.
+        cache->rate = (cache->rate * 3 + cache->ops) / 4;
+        // Periods without operations count as samples equal to zero.
+        for (unsigned long i = 1; i < periods; i++)
+            cache->rate = (cache->rate * 3) / 4;
+    }
+    // The current operation opens the new sampling period.
+    cache->ops          = 1;
+    cache->sample_start = now;
+    __cache_set_band(cache, cache->rate);
 }
 
 static bb_page_t *__cached_alloc(bb_instance_t *instance)
 {
-    if (instance->free_pages_cache_size < LOW_WATERMARK_LEVEL) {
+    bb_page_t *page = NULL;
+    // The cache belongs to this CPU, disabling interrupts is enough to own it.
+    uint8_t flags = irq_nested_disable();
+    bb_page_cache_t *cache = __get_cpu_cache(instance);
+    __cache_account(cache);
+    if (cache->size < cache->low_watermark) {
         // Request pages from the buddy system
-        uint32_t pages_to_request = MID_WATERMARK_LEVEL - instance->free_pages_cache_size;
-        __cache_extend(instance, pages_to_request);
+        __cache_extend(instance, cache, cache->mid_watermark - cache->size);
+        instance->stats.cache_misses++;
+        instance->stats.cache_refills++;
+    } else {
+        instance->stats.cache_hits++;
+    }
+    list_head *page_list = list_head_pop(&cache->pages);
+    if (page_list != NULL) {
+        page = list_entry(page_list, bb_page_t, location.cache);
+        cache->size--;
     }
-    list_head *page_list = list_head_pop(&instance->free_pages_cache_list);
-    bb_page_t *page      = list_entry(page_list, bb_page_t, location.cache);
+    irq_nested_enable(flags);
     return page;
 }
 
 static void __cached_free(bb_instance_t *instance, bb_page_t *page)
 {
-    list_head_insert_after(&page->location.cache, &instance->free_pages_cache_list);
-
-    if (instance->free_pages_cache_size > HIGH_WATERMARK_LEVEL) {
+    uint8_t flags = irq_nested_disable();
+    bb_page_cache_t *cache = __get_cpu_cache(instance);
+    __cache_account(cache);
+    // Keep the page at the head, it is the hottest one.
+    list_head_insert_after(&page->location.cache, &cache->pages);
+    cache->size++;
+    if (cache->size > cache->high_watermark) {
         // Free pages to the buddy system
-        uint32_t pages_to_free = instance->free_pages_cache_size - MID_WATERMARK_LEVEL;
-        __cache_shrink(instance, pages_to_free);
+        __cache_shrink(instance, cache, cache->size - cache->mid_watermark);
+        instance->stats.cache_drains++;
     }
+    irq_nested_enable(flags);
 }
 
 bb_page_t *bb_alloc_page_cached(bb_instance_t *instance)
@@ -399,3 +1543,85 @@ void bb_free_page_cached(bb_instance_t *instance, bb_page_t *page)
 {
     __cached_free(instance, page);
 }
+
+bb_page_t *bb_alloc_page_zeroed(bb_instance_t *instance)
+{
+    bb_page_t *page = NULL;
+    uint8_t flags   = irq_nested_disable();
+    bb_page_cache_t *cache = __get_cpu_cache(instance);
+    list_head *page_list   = list_head_pop(&cache->zeroed);
+    if (page_list != NULL) {
+        page = list_entry(page_list, bb_page_t, location.cache);
+        cache->zeroed_size--;
+        instance->stats.zeroed_hits++;
+    } else {
+        instance->stats.zeroed_misses++;
+    }
+    irq_nested_enable(flags);
+    return page;
+}
+
+void bb_free_page_zeroed(bb_instance_t *instance, bb_page_t *page)
+{
+    uint8_t flags = irq_nested_disable();
+    bb_page_cache_t *cache = __get_cpu_cache(instance);
+    if (cache->zeroed_size < BB_ZEROED_PAGES) {
+        list_head_insert_after(&page->location.cache, &cache->zeroed);
+        cache->zeroed_size++;
+    } else {
+        // The list is full, the page goes back with the others.
+        __cached_free(instance, page);
+    }
+    irq_nested_enable(flags);
+}
+
+unsigned long bb_zeroed_pages_missing(bb_instance_t *instance)
+{
+    bb_page_cache_t *cache = __get_cpu_cache(instance);
+    return (cache->zeroed_size < BB_ZEROED_PAGES) ? (BB_ZEROED_PAGES - cache->zeroed_size) : 0;
+}
+
+bb_page_t *bb_alloc_pages_contig(bb_instance_t *instance, unsigned int order)
+{
+    if (order >= MAX_BUDDYSYSTEM_GFP_ORDER) {
+        return NULL;
+    }
+    uint8_t flags   = __bb_lock(instance);
+    bb_page_t *page = __alloc_block(instance, order, BB_MIGRATE_CMA);
+    __bb_unlock(instance, flags);
+    if (!page && (instance->cma_start < instance->size)) {
+        // The reserved region lends its free pages to the cache, take back
+        // the ones that are not in use. The pages in use cannot be moved, we
+        // do not know who maps them, they come back when they are freed.
+        flags                  = irq_nested_disable();
+        bb_page_cache_t *cache = __get_cpu_cache(instance);
+        // The zeroed pages go back to the cache first.
+        while (!list_head_empty(&cache->zeroed)) {
+            list_head_insert_after(list_head_pop(&cache->zeroed), &cache->pages);
+            cache->zeroed_size--;
+            cache->size++;
+        }
+        unsigned long cached = cache->size;
+        __cache_shrink(instance, cache, cached);
+        instance->stats.cma_reclaimed += cached;
+        irq_nested_enable(flags);
+        flags = __bb_lock(instance);
+        page  = __alloc_block(instance, order, BB_MIGRATE_CMA);
+        __bb_unlock(instance, flags);
+    }
+    flags = __bb_lock(instance);
+    if (!page) {
+        // Fall back to the rest of the memory.
+        page = __alloc_block(instance, order, BB_MIGRATE_UNMOVABLE);
+    }
+    if (page) {
+        instance->stats.allocs[order]++;
+        instance->stats.contig_allocs++;
+    } else {
+        instance->stats.contig_failures++;
+    }
+    __debug_tick(instance);
+    __bb_unlock(instance, flags);
+    __debug_set_site(page, __builtin_return_address(0));
+    return page;
+}
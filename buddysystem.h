@@ -0,0 +1,377 @@
+/// @file buddysystem.h
+/// @brief Buddy System.
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "klib/list_head.h"
+#include "klib/spinlock.h"
+#include "klib/stdatomic.h"
+#include "stdbool.h"
+#include "stddef.h"
+#include "stdint.h"
+
+/// @brief Max gfp pages order of buddysystem blocks.
+#define MAX_BUDDYSYSTEM_GFP_ORDER 14
+
+/// @brief Number of CPUs for which the buddy system keeps a page cache.
+#ifndef BB_MAX_CPUS
+#define BB_MAX_CPUS 1
+#endif
+
+/// @brief Returns the index of the CPU we are running on, used to select the
+/// page cache. MentOS runs on a single CPU, so it defaults to 0.
+#ifndef bb_current_cpu
+#define bb_current_cpu() 0U
+#endif
+
+/// @brief Enables the debug mode: the instances are checked for consistency
+/// every BB_DEBUG_CHECK_INTERVAL operations, the freed pages are poisoned and
+/// the poison is verified when they are allocated again, and the call site of
+/// each allocation is recorded. With 0, none of it is compiled.
+#ifndef BB_DEBUG
+#define BB_DEBUG 0
+#endif
+
+/// @brief Mobility classes of the allocations. The free lists are split by
+/// class and each pageblock is owned by one of them, so that long-lived
+/// allocations do not get scattered among short-lived ones.
+typedef enum bb_migrate_type_t {
+    BB_MIGRATE_UNMOVABLE,   ///< Kernel allocations that stay where they are.
+    BB_MIGRATE_RECLAIMABLE, ///< Allocations that can be freed on demand (e.g., caches).
+    BB_MIGRATE_MOVABLE,     ///< Short-lived or relocatable allocations (e.g., user pages).
+    BB_MIGRATE_CMA,         ///< Region reserved to large contiguous allocations, lent to movable pages meanwhile.
+    BB_MIGRATE_TYPES        ///< Number of mobility classes.
+} bb_migrate_type_t;
+
+/// @brief Provide the offset of the element inside the given type of page.
+#define BBSTRUCT_OFFSET(page, element) \
+    ((uint32_t) & (((page *)NULL)->element))
+
+/// @brief Returns the address of the given element of a given type of page,
+///        based on the provided bbstruct.
+#define PG_FROM_BBSTRUCT(bbstruct, page, element) \
+    ((page *)(((uint32_t)(bbstruct)) - BBSTRUCT_OFFSET(page, element)))
+
+/// The base structure representing a bb page
+typedef struct bb_page_t {
+    /// The order of the block, valid while the page is the root of a used block.
+    uint32_t order;
+    /// Keep track of where the page is located.
+    union {
+        /// The page siblings when not allocated.
+        list_head siblings;
+        /// The cache list pointer when allocated but on cache.
+        list_head cache;
+    } location;
+#if BB_DEBUG
+    /// Where the block has been allocated, valid while the page is the root of a used block.
+    void *alloc_site;
+    /// Tells if the page has been filled with the poison since it was freed.
+    bool_t poisoned;
+#endif
+} bb_page_t;
+
+/// @brief Buddy system descriptor: collection of free page blocks.
+/// Each block represents 2^k free contiguous page.
+typedef struct bb_free_area_t {
+    /// free_list collectes the first page descriptors of a blocks of 2^k
+    /// frames, one list for each mobility class.
+    list_head free_list[BB_MIGRATE_TYPES];
+    /// nr_free specifies the number of blocks of free pages, of all classes.
+    int nr_free;
+    /// lazy_list collects the free blocks of 2^k frames not yet coalesced,
+    /// one list for each mobility class.
+    list_head lazy_list[BB_MIGRATE_TYPES];
+    /// nr_lazy specifies the number of blocks in the lazy lists.
+    int nr_lazy;
+} bb_free_area_t;
+
+/// @brief Per-CPU cache of single (order 0) pages, refilled from and drained
+/// to the buddy system in batches.
+typedef struct bb_page_cache_t {
+    /// List of the cached pages.
+    list_head pages;
+    /// Number of pages currently in the cache.
+    unsigned long size;
+    /// Below this level the cache is refilled from the buddy system.
+    unsigned long low_watermark;
+    /// Level the cache is brought back to after a refill or a drain.
+    unsigned long mid_watermark;
+    /// Above this level the cache is drained to the buddy system.
+    unsigned long high_watermark;
+    /// Moving average of the cached alloc/free operations per sampling period.
+    unsigned long rate;
+    /// Number of cached alloc/free operations in the current sampling period.
+    unsigned long ops;
+    /// Tick at which the current sampling period started.
+    unsigned long sample_start;
+    /// List of the cached pages known to be filled with zeros.
+    list_head zeroed;
+    /// Number of pages in the zeroed list.
+    unsigned long zeroed_size;
+} bb_page_cache_t;
+
+/// @brief Number of buckets of the allocation latency histogram.
+#define BB_LATENCY_BUCKETS 32
+
+/// @brief Allocation statistics of a buddy system instance.
+typedef struct bb_stats_t {
+    /// Number of blocks allocated, for each order.
+    unsigned long allocs[MAX_BUDDYSYSTEM_GFP_ORDER];
+    /// Number of blocks freed, for each order.
+    unsigned long frees[MAX_BUDDYSYSTEM_GFP_ORDER];
+    /// Number of allocation requests that could not be (fully) satisfied.
+    unsigned long alloc_failures;
+    /// Number of allocations served from the free lists of another class.
+    unsigned long fallbacks;
+    /// Number of times a block has been split in two buddies.
+    unsigned long splits;
+    /// Number of times two buddies have been merged.
+    unsigned long merges;
+    /// Number of cached allocations served without refilling the cache.
+    unsigned long cache_hits;
+    /// Number of cached allocations that had to refill the cache.
+    unsigned long cache_misses;
+    /// Number of batches moved from the buddy system to a cache.
+    unsigned long cache_refills;
+    /// Number of batches moved from a cache to the buddy system.
+    unsigned long cache_drains;
+    /// Number of zeroed page requests served from the zeroed lists.
+    unsigned long zeroed_hits;
+    /// Number of zeroed page requests that found the zeroed lists empty.
+    unsigned long zeroed_misses;
+    /// Number of pages filled with zeros by the users of the instance.
+    unsigned long zeroed_pages;
+    /// Cycles spent filling those pages, mapping them included.
+    unsigned long zero_cycles;
+    /// Histogram of bb_alloc_pages durations: bucket k counts the calls that
+    /// took between 2^k and 2^(k+1) cycles.
+    unsigned long alloc_latency[BB_LATENCY_BUCKETS];
+    /// Number of times the lock of the instance has been taken.
+    unsigned long lock_acquisitions;
+    /// Number of times the lock was busy and we had to spin.
+    unsigned long lock_contentions;
+    /// Histogram of the lock hold times: bucket k counts the critical sections
+    /// that took between 2^k and 2^(k+1) cycles.
+    unsigned long lock_hold[BB_LATENCY_BUCKETS];
+    /// Longest time the lock has been held, in cycles.
+    unsigned long lock_max_hold;
+    /// Number of blocks allocated through bb_alloc_pages_contig.
+    unsigned long contig_allocs;
+    /// Number of bb_alloc_pages_contig requests that could not be satisfied.
+    unsigned long contig_failures;
+    /// Number of blocks of the reserved region lent to movable allocations.
+    unsigned long cma_lent;
+    /// Number of cached pages given back to the buddy system to make room
+    /// for a contiguous allocation.
+    unsigned long cma_reclaimed;
+#if BB_DEBUG
+    /// Number of consistency checks of the instance.
+    unsigned long debug_checks;
+    /// Number of operations since the last consistency check.
+    unsigned long debug_ops;
+#endif
+} bb_stats_t;
+
+/// @brief Buddy system instance,
+/// that represents a memory area managed by the buddy system
+typedef struct bb_instance_t {
+    /// Name of this bb instance
+    const char *name;
+    /// List of buddy system pages grouped by level.
+    bb_free_area_t free_area[MAX_BUDDYSYSTEM_GFP_ORDER];
+    /// Bitmask of the orders having free blocks, coalesced or not (bit k <=>
+    /// order k), for each mobility class.
+    unsigned long free_orders[BB_MIGRATE_TYPES];
+    /// Defers the merge of freed blocks with their buddies (lazy buddy).
+    bool_t lazy_coalescing;
+    /// Metadata of the pages, one byte each: the order of the block in the
+    /// lower bits, and the free/root/lazy flags in the upper ones.
+    uint8_t *page_info;
+    /// Mobility class owning each pageblock.
+    uint8_t *pageblock_type;
+    /// Protects the free areas, the metadata tables and the statistics. The
+    /// per-CPU caches do not take it, except when they are refilled or drained.
+    spinlock_t lock;
+    /// Time-stamp of when the lock has been taken, to measure the hold time.
+    uint32_t lock_start;
+    /// Single page caches, one for each CPU.
+    bb_page_cache_t cpu_cache[BB_MAX_CPUS];
+    /// Buddysystem instance size in number of pages.
+    unsigned long size;
+    /// Index of the first page of the region reserved to contiguous
+    /// allocations, which goes until the end of the instance.
+    unsigned long cma_start;
+    /// Address of the first managed page
+    bb_page_t *base_page;
+    /// Size of the (padded) wrapper page structure
+    unsigned long pgs_size;
+    /// Offset of the bb_page_t struct from the start of the whole structure
+    unsigned long bbpg_offset;
+    /// Allocation statistics.
+    bb_stats_t stats;
+} bb_instance_t;
+
+/// @brief  Allocate a block of page frames of size 2^order.
+/// @param instance A buddy system instance.
+/// @param order    The logarithm of the size of the block.
+/// @return The address of the first page descriptor of the block, or NULL.
+bb_page_t *bb_alloc_pages(bb_instance_t *instance, unsigned int order);
+
+/// @brief  Allocate a block of page frames of size 2^order, of the given
+///         mobility class. bb_alloc_pages allocates unmovable blocks.
+/// @param instance A buddy system instance.
+/// @param order    The logarithm of the size of the block.
+/// @param type     The mobility class of the allocation, the reserved region
+///                 is only reached through bb_alloc_pages_contig.
+/// @return The address of the first page descriptor of the block, or NULL.
+bb_page_t *bb_alloc_pages_type(bb_instance_t *instance, unsigned int order, bb_migrate_type_t type);
+
+/// @brief Free a block of page frames of size 2^order.
+/// @param instance A buddy system instance.
+/// @param page     The address of the first page descriptor of the block.
+void bb_free_pages(bb_instance_t *instance, bb_page_t *page);
+
+/// @brief Turns a used block of page frames of size 2^order in 2^order used
+///        blocks of a single page, which can then be freed one at a time.
+/// @param instance A buddy system instance.
+/// @param page     The address of the first page descriptor of the block,
+///                 nothing is done if it is not the first page of a used block.
+void bb_split_pages(bb_instance_t *instance, bb_page_t *page);
+
+/// @brief Allocate up to count blocks of page frames of size 2^order, taking
+///        them from as few larger blocks as possible.
+/// @param instance A buddy system instance.
+/// @param order    The logarithm of the size of each block.
+/// @param type     The mobility class of the allocation.
+/// @param count    The number of blocks to allocate.
+/// @param pages    Array of at least count entries that receives, for each
+///                 block, the address of its first page descriptor.
+/// @return The number of blocks actually allocated (less than count when the
+///         buddy system runs out of memory).
+unsigned int bb_alloc_pages_bulk(bb_instance_t *instance, unsigned int order, bb_migrate_type_t type, unsigned int count, bb_page_t **pages);
+
+/// @brief Free count blocks of page frames, merging adjacent ones in a single pass.
+/// @param instance A buddy system instance.
+/// @param pages    Array with the first page descriptor of each block, it is
+///                 reordered by the function.
+/// @param count    The number of blocks in the array.
+void bb_free_pages_bulk(bb_instance_t *instance, bb_page_t **pages, unsigned int count);
+
+/// @brief Allocate a block of page frames of size 2^order for a user that
+///        needs them physically contiguous (e.g., DMA buffers, frame buffers).
+///        The block is taken first from the reserved region, after having
+///        taken back the pages it lent to the cache of this CPU, and then from
+///        the rest of the memory. Free it with bb_free_pages.
+/// @param instance A buddy system instance.
+/// @param order    The logarithm of the size of the block.
+/// @return The address of the first page descriptor of the block, or NULL.
+bb_page_t *bb_alloc_pages_contig(bb_instance_t *instance, unsigned int order);
+
+/// @brief Alloc a page using bb cache.
+/// @param instance Buddy system instance.
+/// @return An allocated page.
+bb_page_t *bb_alloc_page_cached(bb_instance_t *instance);
+
+/// @brief Free a page allocated with bb_alloc_page_cached.
+/// @param instance Buddy system instance.
+/// @param page     The address of the first page descriptor of the block.
+void bb_free_page_cached(bb_instance_t *instance, bb_page_t *page);
+
+/// @brief Takes a page from the list of zeroed pages of this CPU.
+/// @param instance Buddy system instance.
+/// @return A page filled with zeros, or NULL if there is none.
+bb_page_t *bb_alloc_page_zeroed(bb_instance_t *instance);
+
+/// @brief Puts a page allocated with bb_alloc_page_cached, which has just been
+///        filled with zeros, in the list of zeroed pages of this CPU.
+/// @param instance Buddy system instance.
+/// @param page     The address of the page descriptor.
+void bb_free_page_zeroed(bb_instance_t *instance, bb_page_t *page);
+
+/// @brief Returns how many pages the zeroed list of this CPU is missing.
+/// @param instance Buddy system instance.
+/// @return The number of pages to add to fill the list.
+unsigned long bb_zeroed_pages_missing(bb_instance_t *instance);
+
+/// @brief Initialize Buddy System.
+/// @param instance      A buddysystem instance.
+/// @param name          The name of the current instance (for debug purposes)
+/// @param pages_start   The start address of the page structures
+/// @param bbpage_offset The offset from the start of the whole page of the
+///                      bb_page_t struct.
+/// @param pages_stride  The (padded) size of the whole page structure
+/// @param pages_count   The number of pages in this region, the pages past the
+///                      last block of the largest order go to the lower orders.
+void buddy_system_init(
+    bb_instance_t *instance,
+    const char *name,
+    void *pages_start,
+    uint32_t bbpage_offset,
+    uint32_t pages_stride,
+    uint32_t pages_count);
+
+/// @brief Initialize Buddy System, reserving the last pages of the region to
+///        the contiguous allocations of bb_alloc_pages_contig.
+/// @param instance       A buddysystem instance.
+/// @param name           The name of the current instance (for debug purposes)
+/// @param pages_start    The start address of the page structures
+/// @param bbpage_offset  The offset from the start of the whole page of the
+///                       bb_page_t struct.
+/// @param pages_stride   The (padded) size of the whole page structure
+/// @param pages_count    The number of pages in this region.
+/// @param reserved_count The number of pages to reserve, rounded down to whole
+///                       pageblocks and to at most a quarter of the region.
+void buddy_system_init_reserved(
+    bb_instance_t *instance,
+    const char *name,
+    void *pages_start,
+    uint32_t bbpage_offset,
+    uint32_t pages_stride,
+    uint32_t pages_count,
+    uint32_t reserved_count);
+
+/// @brief Selects how freed blocks are merged with their buddies.
+/// @param instance A buddy system instance.
+/// @param enable   If true, freed blocks stay at their order until too many of
+///                 them pile up or a larger block is needed (lazy mode);
+///                 otherwise they are merged right away (eager mode). Switching
+///                 to eager mode merges all the pending blocks.
+void buddy_system_set_lazy_coalescing(bb_instance_t *instance, bool_t enable);
+
+/// @brief Checks that the free lists agree with the metadata of the pages:
+/// each listed block must be a free root of the order and class of its list,
+/// nr_free and nr_lazy must match the length of the lists, and every free
+/// root must be listed. The inconsistencies found are printed.
+/// @param instance The buddy system instance.
+/// @return The number of inconsistencies found.
+int buddy_system_check(bb_instance_t *instance);
+
+/// @brief Print the size of free_list of each free_area.
+/// @param instance A buddy system instance.
+void buddy_system_dump(bb_instance_t *instance);
+
+/// @brief Writes the allocation statistics of the instance in textual form,
+///        as they are shown by procfs.
+/// @param instance A buddy system instance.
+/// @param buffer   The buffer where the statistics are written.
+/// @param bufsize  The size of the buffer, lines that do not fit are dropped.
+/// @return The number of characters written, excluding the terminator.
+size_t buddy_system_read_stats(bb_instance_t *instance, char *buffer, size_t bufsize);
+
+/// @brief Returns the total space for the given instance.
+/// @param instance A buddy system instance.
+/// @return The requested total sapce.
+unsigned long buddy_system_get_total_space(bb_instance_t *instance);
+
+/// @brief Returns the free space for the given instance.
+/// @param instance A buddy system instance.
+/// @return The requested total sapce.
+unsigned long buddy_system_get_free_space(bb_instance_t *instance);
+
+/// @brief Returns the cached space for the given instance.
+/// @param instance A buddy system instance.
+/// @return The requested total sapce.
+unsigned long buddy_system_get_cached_space(bb_instance_t *instance);
@@ -0,0 +1,195 @@
+/// @file t_mem.c
+/// @brief Allocation benchmark: times malloc/free under several workloads and
+/// reports the results, together with the state of the buddy system before
+/// and after, in a machine-readable format (one `key=value` record per line).
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/unistd.h>
+#include <sys/wait.h>
+
+/// The maximum number of latency samples kept for each workload.
+#define MAX_SAMPLES 2048
+/// The number of live allocations of the random-lifetime workload.
+#define LIVE_SLOTS 64
+/// The largest allocation, as a power of two: sizes go up to 4 KiB.
+#define MAX_SIZE_ORDER 11
+
+/// @brief The statistics of a workload.
+typedef struct bench_stats_t {
+    /// The name of the workload.
+    const char *name;
+    /// A reservoir of the latencies of the operations, in TSC cycles.
+    unsigned long long samples[MAX_SAMPLES];
+    /// The number of timed operations.
+    unsigned int ops;
+    /// The total cycles spent in the operations.
+    unsigned long long cycles;
+    /// The slowest operation.
+    unsigned long long max;
+} bench_stats_t;
+
+static bench_stats_t stats;
+
+static inline unsigned long long __rdtsc(void)
+{
+    unsigned long long tsc;
+    __asm__ __volatile__("rdtsc"
+                         : "=A"(tsc));
+    return tsc;
+}
+
+static inline void __record(unsigned long long cycles)
+{
+    // Reservoir sampling keeps a uniform sample of all the operations.
+    if (stats.ops < MAX_SAMPLES) {
+        stats.samples[stats.ops] = cycles;
+    } else {
+        unsigned int slot = (unsigned int)rand() % (stats.ops + 1);
+        if (slot < MAX_SAMPLES)
+            stats.samples[slot] = cycles;
+    }
+    ++stats.ops;
+    stats.cycles += cycles;
+    if (cycles > stats.max)
+        stats.max = cycles;
+}
+
+static inline void *__timed_malloc(unsigned int size)
+{
+    unsigned long long start = __rdtsc();
+    void *ptr                = malloc(size);
+    __record(__rdtsc() - start);
+    return ptr;
+}
+
+static inline void __timed_free(void *ptr)
+{
+    unsigned long long start = __rdtsc();
+    free(ptr);
+    __record(__rdtsc() - start);
+}
+
+/// @brief Returns a random size, up to 4 KiB, with every power of two equally
+/// likely.
+static inline unsigned int __random_size(void)
+{
+    unsigned int order = (unsigned int)rand() % (MAX_SIZE_ORDER + 1);
+    return (1U << order) + ((unsigned int)rand() % (1U << order));
+}
+
+static inline void __sort(unsigned long long *samples, unsigned int n)
+{
+    for (unsigned int i = 1; i < n; ++i) {
+        unsigned long long value = samples[i];
+        unsigned int j           = i;
+        while ((j > 0) && (samples[j - 1] > value)) {
+            samples[j] = samples[j - 1];
+            --j;
+        }
+        samples[j] = value;
+    }
+}
+
+static inline void __begin(const char *name)
+{
+    memset(&stats, 0, sizeof(bench_stats_t));
+    stats.name = name;
+}
+
+static inline void __report(void)
+{
+    unsigned int n = (stats.ops < MAX_SAMPLES) ? stats.ops : MAX_SAMPLES;
+    if (n == 0)
+        return;
+    __sort(stats.samples, n);
+    // User programs have no 64-bit division, a mcycle is 2^20 cycles.
+    unsigned int mcycles = (unsigned int)(stats.cycles >> 20);
+    printf("memtest workload=%s ops=%u mcycles=%u ops_per_mcycle=%u p50=%u p99=%u max=%u\n",
+           stats.name, stats.ops, mcycles, stats.ops / (mcycles ? mcycles : 1),
+           (unsigned int)stats.samples[(50 * (n - 1)) / 100],
+           (unsigned int)stats.samples[(99 * (n - 1)) / 100],
+           (unsigned int)stats.max);
+}
+
+/// @brief Prints the state of the buddy system, from /proc/buddyinfo.
+static inline void __snapshot(const char *when)
+{
+    char buffer[BUFSIZ];
+    int fd = open("/proc/buddyinfo", O_RDONLY, 0);
+    if (fd == -1)
+        return;
+    ssize_t ret;
+    // Tag every line, so that it can be told apart from the other outputs. A
+    // line can span two reads, so the start of a line is kept between them.
+    int line_start = 1;
+    while ((ret = read(fd, buffer, BUFSIZ)) > 0) {
+        for (ssize_t i = 0; i < ret; ++i) {
+            if (line_start)
+                printf("memtest snapshot=%s ", when);
+            putchar(buffer[i]);
+            line_start = (buffer[i] == '\n');
+        }
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        printf("Mem test requires the number of times to alloc, as second parameter\n");
+        return 1;
+    }
+    char *ptr;
+    int N = strtol(argv[1], &ptr, 10), *V;
+    // The seed can be given, to repeat the same workload between builds.
+    srand((argc > 2) ? strtol(argv[2], &ptr, 10) : 1);
+    __snapshot("before");
+
+    // Allocations of increasing size, freed right away.
+    __begin("sweep");
+    for (int i = 0; i < N; ++i) {
+        for (int j = 1; j < N; ++j) {
+            V = (int *)__timed_malloc(j * sizeof(int));
+            __timed_free(V);
+        }
+    }
+    __report();
+
+    // Bursts of allocations of random size, freed in reverse order.
+    __begin("burst");
+    for (int i = 0; i < N; ++i) {
+        void *burst[LIVE_SLOTS];
+        for (int j = 0; j < LIVE_SLOTS; ++j)
+            burst[j] = __timed_malloc(__random_size());
+        for (int j = LIVE_SLOTS - 1; j >= 0; --j)
+            __timed_free(burst[j]);
+    }
+    __report();
+
+    // Allocations of random size and random lifetime.
+    __begin("lifetime");
+    void *live[LIVE_SLOTS] = { 0 };
+    for (int i = 0; i < (N * LIVE_SLOTS); ++i) {
+        unsigned int slot = (unsigned int)rand() % LIVE_SLOTS;
+        if (live[slot]) {
+            __timed_free(live[slot]);
+            live[slot] = NULL;
+        } else {
+            live[slot] = __timed_malloc(__random_size());
+        }
+    }
+    for (int slot = 0; slot < LIVE_SLOTS; ++slot)
+        if (live[slot])
+            free(live[slot]);
+    __report();
+
+    __snapshot("after");
+
+    printf("Mem test passed with %d allocations and deallocations\n", N);
+    return 0;
+}
@@ -0,0 +1,342 @@
+/// @file proc_system.c
+/// @brief Contains callbacks for procfs system files.
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "fs/procfs.h"
+#include "version.h"
+#include "process/process.h"
+#include "process/scheduler.h"
+#include "string.h"
+#include "stdio.h"
+#include "sys/errno.h"
+#include "io/debug.h"
+#include "hardware/timer.h"
+#include "mem/zone_allocator.h"
+#include "mem/paging.h"
+#include "mem/slab.h"
+
+static ssize_t procs_do_uptime(char *buffer, size_t bufsize);
+
+static ssize_t procs_do_version(char *buffer, size_t bufsize);
+
+static ssize_t procs_do_mounts(char *buffer, size_t bufsize);
+
+static ssize_t procs_do_cpuinfo(char *buffer, size_t bufsize);
+
+static ssize_t procs_do_meminfo(char *buffer, size_t bufsize);
+
+static ssize_t procs_do_stat(char *buffer, size_t bufsize);
+
+static ssize_t procs_do_sched_policy(char *buffer, size_t bufsize);
+
+/// The size of the buffer /proc/buddyinfo is written to.
+#define BUDDYINFO_SIZE (2 * PAGE_SIZE)
+
+static ssize_t procs_read_buddyinfo(char *buf, off_t offset, size_t nbyte);
+
+/// The lock taken and released through /proc/sched_lock, to make the tasks of
+/// the benchmarks contend for a resource.
+static wait_queue_head_t sched_lock;
+
+static ssize_t procs_read(vfs_file_t *file, char *buf, off_t offset, size_t nbyte)
+{
+    if (file == NULL)
+        return -EFAULT;
+    proc_dir_entry_t *entry = (proc_dir_entry_t *)file->device;
+    if (entry == NULL)
+        return -EFAULT;
+    // The scheduler trace is binary, and it is drained by reading it.
+    if (strcmp(entry->name, "sched_trace") == 0)
+        return scheduler_trace_read(buf, nbyte);
+    // The statistics of the buddy system do not fit in BUFSIZ.
+    if (strcmp(entry->name, "buddyinfo") == 0)
+        return procs_read_buddyinfo(buf, offset, nbyte);
+    // Prepare a buffer.
+    char buffer[BUFSIZ];
+    memset(buffer, 0, BUFSIZ);
+    // Call the specific function.
+    int ret = 0;
+    if (strcmp(entry->name, "uptime") == 0)
+        ret = procs_do_uptime(buffer, BUFSIZ);
+    else if (strcmp(entry->name, "version") == 0)
+        ret = procs_do_version(buffer, BUFSIZ);
+    else if (strcmp(entry->name, "mounts") == 0)
+        ret = procs_do_mounts(buffer, BUFSIZ);
+    else if (strcmp(entry->name, "cpuinfo") == 0)
+        ret = procs_do_cpuinfo(buffer, BUFSIZ);
+    else if (strcmp(entry->name, "meminfo") == 0)
+        ret = procs_do_meminfo(buffer, BUFSIZ);
+    else if (strcmp(entry->name, "stat") == 0)
+        ret = procs_do_stat(buffer, BUFSIZ);
+    else if (strcmp(entry->name, "sched_policy") == 0)
+        ret = procs_do_sched_policy(buffer, BUFSIZ);
+    // Perform read.
+    ssize_t it = 0;
+    if (ret == 0) {
+        size_t name_len = strlen(buffer);
+        size_t read_pos = offset;
+        if (read_pos < name_len) {
+            while ((it < nbyte) && (read_pos < name_len)) {
+                *buf++ = buffer[read_pos];
+                ++read_pos;
+                ++it;
+            }
+        }
+    }
+    return it;
+}
+
+static ssize_t procs_write(vfs_file_t *file, const void *buf, off_t offset, size_t nbyte)
+{
+    if (file == NULL)
+        return -EFAULT;
+    proc_dir_entry_t *entry = (proc_dir_entry_t *)file->device;
+    if (entry == NULL)
+        return -EFAULT;
+    // Writing 1 takes the lock, 0 releases it. A task which finds the lock
+    // held sleeps, and gets -EAGAIN to try again once woken up.
+    if ((strcmp(entry->name, "sched_lock") == 0) && (nbyte > 0)) {
+        int ret = (((const char *)buf)[0] == '1') ? wait_queue_lock(&sched_lock) : wait_queue_unlock(&sched_lock);
+        return (ret < 0) ? ret : (ssize_t)nbyte;
+    }
+    // Only the scheduling policy can be written.
+    if (strcmp(entry->name, "sched_policy") != 0)
+        return -EINVAL;
+    // Get the name of the policy, without the trailing newline.
+    char name[NAME_MAX];
+    size_t length = 0;
+    while ((length < nbyte) && (length < (NAME_MAX - 1)) && (((const char *)buf)[length] != '\n')) {
+        name[length] = ((const char *)buf)[length];
+        ++length;
+    }
+    name[length] = 0;
+    // Look for the policy with the given name.
+    for (int policy = 0; policy < SCHED_POLICY_COUNT; ++policy) {
+        if (strcmp(scheduler_get_class(policy)->name, name) == 0) {
+            if (scheduler_set_policy(policy) < 0)
+                return -EINVAL;
+            return nbyte;
+        }
+    }
+    return -EINVAL;
+}
+
+/// Filesystem general operations.
+static vfs_sys_operations_t procs_sys_operations = {
+    .mkdir_f = NULL,
+    .rmdir_f = NULL,
+    .stat_f  = NULL
+};
+
+/// Filesystem file operations.
+static vfs_file_operations_t procs_fs_operations = {
+    .open_f     = NULL,
+    .unlink_f   = NULL,
+    .close_f    = NULL,
+    .read_f     = procs_read,
+    .write_f    = procs_write,
+    .lseek_f    = NULL,
+    .stat_f     = NULL,
+    .ioctl_f    = NULL,
+    .getdents_f = NULL
+};
+
+int procs_module_init()
+{
+    proc_dir_entry_t *system_entry;
+    // == /proc/uptime ========================================================
+    if ((system_entry = proc_create_entry("uptime", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/uptime`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/uptime` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/version ========================================================
+    if ((system_entry = proc_create_entry("version", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/version`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/version` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/mounts ========================================================
+    if ((system_entry = proc_create_entry("mounts", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/mounts`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/mounts` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/cpuinfo ========================================================
+    if ((system_entry = proc_create_entry("cpuinfo", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/cpuinfo`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/cpuinfo` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/meminfo ========================================================
+    if ((system_entry = proc_create_entry("meminfo", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/meminfo`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/meminfo` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/stat ========================================================
+    if ((system_entry = proc_create_entry("stat", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/stat`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/stat` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/sched_policy ==================================================
+    if ((system_entry = proc_create_entry("sched_policy", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/sched_policy`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/sched_policy` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/sched_trace ===================================================
+    if ((system_entry = proc_create_entry("sched_trace", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/sched_trace`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/sched_trace` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+
+    // == /proc/sched_lock =====================================================
+    if ((system_entry = proc_create_entry("sched_lock", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/sched_lock`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/sched_lock` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+    spinlock_init(&sched_lock.lock);
+    list_head_init(&sched_lock.task_list);
+
+    // == /proc/buddyinfo =====================================================
+    if ((system_entry = proc_create_entry("buddyinfo", NULL)) == NULL) {
+        pr_err("Cannot create `/proc/buddyinfo`.\n");
+        return 1;
+    }
+    pr_debug("Created `/proc/buddyinfo` (%p)\n", system_entry);
+    // Set the specific operations.
+    system_entry->sys_operations = &procs_sys_operations;
+    system_entry->fs_operations  = &procs_fs_operations;
+    return 0;
+}
+
+static ssize_t procs_do_uptime(char *buffer, size_t bufsize)
+{
+    sprintf(buffer, "%d", timer_get_seconds());
+    return 0;
+}
+
+static ssize_t procs_do_version(char *buffer, size_t bufsize)
+{
+    sprintf(buffer,
+            "%s version %s (site: %s) (email: %s)",
+            OS_NAME,
+            OS_VERSION,
+            OS_SITEURL,
+            OS_REF_EMAIL);
+    return 0;
+}
+
+static ssize_t procs_do_mounts(char *buffer, size_t bufsize)
+{
+    return 0;
+}
+
+static ssize_t procs_do_cpuinfo(char *buffer, size_t bufsize)
+{
+    return 0;
+}
+
+static ssize_t procs_do_meminfo(char *buffer, size_t bufsize)
+{
+    double total_space = get_zone_total_space(GFP_KERNEL) +
+                         get_zone_total_space(GFP_USER),
+           free_space = get_zone_free_space(GFP_KERNEL) +
+                        get_zone_free_space(GFP_USER),
+           cached_space = get_zone_cached_space(GFP_KERNEL) +
+                          get_zone_cached_space(GFP_USER),
+           used_space = total_space - free_space;
+    total_space /= (double)K;
+    free_space /= (double)K;
+    cached_space /= (double)K;
+    used_space /= (double)K;
+    sprintf(
+        buffer,
+        "MemTotal : %12.2f Kb\n"
+        "MemFree  : %12.2f Kb\n"
+        "MemUsed  : %12.2f Kb\n"
+        "Cached   : %12.2f Kb\n",
+        total_space, free_space, used_space, cached_space);
+    return 0;
+}
+
+static ssize_t procs_read_buddyinfo(char *buf, off_t offset, size_t nbyte)
+{
+    char *buffer = kmalloc(BUDDYINFO_SIZE);
+    if (buffer == NULL)
+        return -ENOMEM;
+    // The statistics of the buddy system of each zone, one after the other,
+    // then the ones of the slab caches.
+    size_t length = 0;
+    for (int zone = 0; zone < __MAX_NR_ZONES; ++zone) {
+        length += buddy_system_read_stats(&contig_page_data->node_zones[zone].buddy_system,
+                                          buffer + length, BUDDYINFO_SIZE - length);
+    }
+    length += kmem_cache_read_stats(buffer + length, BUDDYINFO_SIZE - length);
+    ssize_t it = 0;
+    for (size_t read_pos = offset; (it < nbyte) && (read_pos < length); ++read_pos, ++it) {
+        *buf++ = buffer[read_pos];
+    }
+    kfree(buffer);
+    return it;
+}
+
+static ssize_t procs_do_stat(char *buffer, size_t bufsize)
+{
+    return 0;
+}
+
+static ssize_t procs_do_sched_policy(char *buffer, size_t bufsize)
+{
+    // List the policies, the one in use is between brackets.
+    sched_policy_t current = scheduler_get_policy();
+    for (int policy = 0; policy < SCHED_POLICY_COUNT; ++policy) {
+        const char *name = scheduler_get_class(policy)->name;
+        if (policy == current) {
+            sprintf(buffer + strlen(buffer), "[%s] ", name);
+        } else {
+            sprintf(buffer + strlen(buffer), "%s ", name);
+        }
+    }
+    buffer[strlen(buffer) - 1] = '\n';
+    return 0;
+}
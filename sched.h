@@ -0,0 +1,86 @@
+/// @file sched.h
+/// @brief Structures and functions for managing the scheduler.
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include "sys/types.h"
+#include "time.h"
+#include "stdbool.h"
+
+/// @brief Structure that describes scheduling parameters.
+typedef struct sched_param_t {
+    /// Static execution priority.
+    int sched_priority;
+    /// Expected period of the task
+    time_t period;
+    /// Absolute deadline
+    time_t deadline;
+    /// Absolute time of arrival of the task
+    time_t arrivaltime;
+    /// Is task periodic?
+    bool_t is_periodic;
+} sched_param_t;
+
+/// @brief Sets scheduling parameters.
+/// @param pid pid of the process we want to change the parameters. If zero,
+/// then the parameters of the calling process are set.
+/// @param param The interpretation of the argument param depends on the
+/// scheduling policy of the thread identified by pid.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int sched_setparam(pid_t pid, const sched_param_t *param);
+
+/// @brief Gets scheduling parameters.
+/// @param pid pid of the process we want to retrieve the parameters. If zero,
+/// then the parameters of the calling process are returned.
+/// @param param The interpretation of the argument param depends on the
+/// scheduling policy of the thread identified by pid.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int sched_getparam(pid_t pid, sched_param_t *param);
+
+/// @brief Placed at the end of an infinite while loop, stops the process until,
+/// its next period starts. The calling process must be a periodic one.
+/// @return 0 on success, -1 on failure and errno is set to indicate the error.
+int waitperiod();
+
+/// @brief The scheduling policies (see /proc/sched_policy).
+typedef enum sched_policy_t {
+    SCHED_POLICY_RR,       ///< Round Robin.
+    SCHED_POLICY_PRIORITY, ///< Static priority.
+    SCHED_POLICY_CFS,      ///< Completely Fair Scheduler.
+    SCHED_POLICY_EDF,      ///< Earliest Deadline First, for periodic tasks.
+    SCHED_POLICY_RM,       ///< Rate Monotonic, for periodic tasks.
+    SCHED_POLICY_AEDF,     ///< Aperiodic Earliest Deadline First.
+    SCHED_POLICY_LLF,      ///< Least Laxity First, for periodic tasks.
+    SCHED_POLICY_COUNT     ///< The number of scheduling policies.
+} sched_policy_t;
+
+/// @brief Types of the events of the scheduler trace.
+typedef enum sched_trace_type_t {
+    SCHED_TRACE_PICK,          ///< A task has been picked, data: the cycles spent picking it.
+    SCHED_TRACE_SWITCH,        ///< Switch to pid, from other, data: the cycles spent in the scheduler.
+    SCHED_TRACE_WAKEUP,        ///< A task has been woken up.
+    SCHED_TRACE_RELEASE,       ///< A new period started, data: the deadline.
+    SCHED_TRACE_DEADLINE_MISS, ///< A job ended late, data: the lateness.
+    SCHED_TRACE_WCET_OVERRUN,  ///< A job ran past the WCET, data: the new WCET.
+    SCHED_TRACE_INHERIT,       ///< pid inherits from the waiter other, data: the priority, or the real-time key.
+    SCHED_TRACE_TICK,          ///< The statistics of the running task have been updated, data: the cycles spent.
+    SCHED_TRACE_LOST           ///< Events lost because the trace was full, data: how many.
+} sched_trace_type_t;
+
+/// @brief A record of the scheduler trace, as read from /proc/sched_trace.
+typedef struct sched_trace_event_t {
+    /// Time stamp counter of the event.
+    unsigned long long timestamp;
+    /// Ticks of the event.
+    unsigned int ticks;
+    /// The type of the event (sched_trace_type_t).
+    unsigned short type;
+    /// The scheduling policy in use (sched_policy_t).
+    unsigned short policy;
+    /// The process the event is about.
+    pid_t pid;
+    /// Another process, depending on the type of event.
+    pid_t other;
+    /// Data depending on the type of event.
+    unsigned int data;
+} sched_trace_event_t;
@@ -0,0 +1,228 @@
+/// @file schedbench.c
+/// @brief Runs the same workload, made of CPU-bound and periodic tasks, under
+/// each scheduling policy, and reports the latencies, the cost of the
+/// scheduler and the deadline misses of each one through schedtrace, which
+/// drains the trace for the whole run. With -l all the tasks share a lock, so
+/// that the periodic ones wait for the CPU-bound ones holding it.
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strerror.h>
+#include <sched.h>
+#include <time.h>
+
+/// The maximum number of periodic tasks.
+#define MAX_TASKS 16
+/// The maximum number of CPU-bound tasks, enough to load the pickers.
+#define MAX_CPU_TASKS 1024
+
+/// The names of the policies, as in /proc/sched_policy.
+static char *policy_names[SCHED_POLICY_COUNT] = {
+    "rr", "priority", "cfs", "edf", "rm", "aedf", "llf"
+};
+
+/// @brief The parameters of a periodic task.
+typedef struct periodic_task_t {
+    /// The period (and relative deadline), in ticks.
+    int period;
+    /// The work done in each period, in thousands of iterations.
+    int work;
+} periodic_task_t;
+
+static periodic_task_t periodic[MAX_TASKS] = {
+    { 100, 200 }, { 200, 400 }, { 400, 800 }
+};
+static int num_periodic = 3;
+/// The tasks take /proc/sched_lock around their work.
+static int use_lock = 0;
+
+static inline void __spin(int work)
+{
+    for (volatile int i = 0; i < (work * 1000); ++i) {}
+}
+
+/// @brief Takes the shared lock, sleeping while another task holds it.
+static inline void __lock(int fd)
+{
+    while (write(fd, "1", 1) < 0) {}
+}
+
+/// @brief Releases the shared lock.
+static inline void __unlock(int fd)
+{
+    write(fd, "0", 1);
+}
+
+/// @brief Spins for the given work, holding the shared lock when asked to.
+static inline void __work(int fd, int work)
+{
+    if (fd != -1)
+        __lock(fd);
+    __spin(work);
+    if (fd != -1)
+        __unlock(fd);
+}
+
+static inline void __run_periodic(periodic_task_t *task, int fd)
+{
+    sched_param_t param;
+    sched_getparam(getpid(), &param);
+    param.period      = task->period;
+    param.deadline    = task->period;
+    param.is_periodic = true;
+    sched_setparam(getpid(), &param);
+    while (1) {
+        __work(fd, task->work);
+        // The task has not been admitted, tell it to the parent.
+        if (waitperiod() == -1)
+            exit(1);
+    }
+}
+
+static inline int __write_file(const char *path, char *text)
+{
+    int fd = open(path, O_WRONLY, 0);
+    if (fd == -1)
+        return -1;
+    ssize_t ret = write(fd, text, strlen(text));
+    close(fd);
+    return (ret < 0) ? -1 : 0;
+}
+
+static inline void __drain_trace(void)
+{
+    char buffer[BUFSIZ];
+    int fd = open("/proc/sched_trace", O_RDONLY, 0);
+    if (fd == -1)
+        return;
+    while (read(fd, buffer, BUFSIZ) > 0) {}
+    close(fd);
+}
+
+/// @brief Reads the policy in use, the one in brackets in /proc/sched_policy.
+static inline int __current_policy(char *policy, size_t size)
+{
+    char buffer[BUFSIZ];
+    int fd = open("/proc/sched_policy", O_RDONLY, 0);
+    if (fd == -1)
+        return -1;
+    ssize_t ret = read(fd, buffer, BUFSIZ - 1);
+    close(fd);
+    if (ret <= 0)
+        return -1;
+    buffer[ret] = 0;
+    char *start = strchr(buffer, '['), *end = start ? strchr(start, ']') : NULL;
+    if (!end || ((size_t)(end - start) > size))
+        return -1;
+    memcpy(policy, start + 1, end - start - 1);
+    policy[end - start - 1] = 0;
+    return 0;
+}
+
+static pid_t pids[MAX_CPU_TASKS + MAX_TASKS];
+
+static inline void __bench(char *policy, int num_cpu, int seconds)
+{
+    int num_pids = 0, rejected = 0, status;
+    char duration[16];
+
+    if (__write_file("/proc/sched_policy", policy) == -1) {
+        printf("schedbench: cannot select the `%s` policy: %s\n", policy, strerror(errno));
+        return;
+    }
+    // Only the events of this run are reported.
+    __drain_trace();
+    for (int i = 0; i < (num_cpu + num_periodic); ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int fd = use_lock ? open("/proc/sched_lock", O_WRONLY, 0) : -1;
+            if (i < num_cpu)
+                while (1) __work(fd, 1000);
+            __run_periodic(&periodic[i - num_cpu], fd);
+        }
+        // With many tasks the system can run out of memory, run with the ones created.
+        if (pid < 0) {
+            printf("schedbench: cannot create task %d: %s\n", i, strerror(errno));
+            break;
+        }
+        pids[num_pids++] = pid;
+    }
+    // The trace fills up in a fraction of a second, schedtrace reads it
+    // while the tasks run and reports at the end.
+    sprintf(duration, "%d", seconds);
+    pid_t tracer = fork();
+    if (tracer == 0) {
+        char *_argv[] = { "/bin/schedtrace", "-t", duration, NULL };
+        execv(_argv[0], _argv);
+        printf("schedbench: cannot run schedtrace: %s\n", strerror(errno));
+        exit(1);
+    }
+    if (tracer > 0)
+        waitpid(tracer, NULL, 0);
+    for (int i = 0; i < num_pids; ++i) {
+        kill(pids[i], SIGKILL);
+    }
+    for (int i = 0; i < num_pids; ++i) {
+        if ((waitpid(pids[i], &status, 0) == pids[i]) && WIFEXITED(status) && (WEXITSTATUS(status) == 1))
+            ++rejected;
+    }
+    printf("schedbench policy=%s cpu_bound=%d periodic=%d lock=%d created=%d rejected=%d seconds=%d\n",
+           policy, num_cpu, num_periodic, use_lock, num_pids, rejected, seconds);
+}
+
+int main(int argc, char *argv[])
+{
+    int num_cpu = 2, seconds = 2, custom = 0;
+    char *policies[SCHED_POLICY_COUNT];
+    int num_policies = 0;
+    char *ptr;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && (i + 1 < argc)) {
+            num_cpu = strtol(argv[++i], &ptr, 10);
+        } else if (!strcmp(argv[i], "-t") && (i + 1 < argc)) {
+            seconds = strtol(argv[++i], &ptr, 10);
+        } else if (!strcmp(argv[i], "-l")) {
+            use_lock = 1;
+        } else if (!strcmp(argv[i], "-r") && (i + 1 < argc)) {
+            // The periodic tasks given replace the default ones.
+            if (!custom)
+                num_periodic = 0, custom = 1;
+            if (num_periodic < MAX_TASKS) {
+                periodic[num_periodic].period = strtol(argv[++i], &ptr, 10);
+                periodic[num_periodic].work   = (*ptr == ':') ? strtol(ptr + 1, &ptr, 10) : 100;
+                ++num_periodic;
+            } else {
+                ++i;
+            }
+        } else if ((argv[i][0] != '-') && (num_policies < SCHED_POLICY_COUNT)) {
+            policies[num_policies++] = argv[i];
+        } else {
+            printf("Usage: %s [-n cpu_bound] [-t seconds] [-l] [-r period:work]... [policy]...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (num_cpu > MAX_CPU_TASKS)
+        num_cpu = MAX_CPU_TASKS;
+    // Without a list, all the policies are compared.
+    if (num_policies == 0) {
+        for (int p = 0; p < SCHED_POLICY_COUNT; ++p)
+            policies[num_policies++] = policy_names[p];
+    }
+    char previous[32];
+    int restore = __current_policy(previous, sizeof(previous)) == 0;
+    for (int p = 0; p < num_policies; ++p) {
+        __bench(policies[p], num_cpu, seconds);
+    }
+    // Leave the system with the policy it had.
+    if (restore)
+        __write_file("/proc/sched_policy", previous);
+    return 0;
+}
@@ -0,0 +1,219 @@
+/// @file schedtrace.c
+/// @brief Summarizes the scheduler trace, read from /proc/sched_trace, into
+/// wakeup-to-run latency, scheduler and tick handler cost, and deadline miss
+/// statistics per scheduling policy. With -t the trace is drained for the
+/// given seconds while the workload runs, since it only holds a fraction of a
+/// second of events.
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#include <sys/unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <strerror.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+
+/// The maximum number of latency samples kept for each policy.
+#define MAX_SAMPLES 1024
+/// The number of processes whose pending wakeup is tracked.
+#define PID_SLOTS 256
+/// The nanoseconds between two reads of the trace with -t, well below the
+/// time it takes to fill it. The kernel rounds the sleep up to a tick.
+#define DRAIN_INTERVAL_NS 50000000L
+
+/// The names of the policies, as in /proc/sched_policy.
+static const char *policy_names[SCHED_POLICY_COUNT] = {
+    "rr", "priority", "cfs", "edf", "rm", "aedf", "llf"
+};
+
+/// The statistics of a policy.
+typedef struct policy_stats_t {
+    /// The latencies between a wakeup (or release) and the switch to the task.
+    unsigned long long samples[MAX_SAMPLES];
+    /// The number of latencies.
+    unsigned int num_samples;
+    /// The cycles spent picking the next task.
+    unsigned long long picks[MAX_SAMPLES];
+    /// The number of picks.
+    unsigned int num_picks;
+    /// The cycles spent updating the statistics of the running task.
+    unsigned long long ticks[MAX_SAMPLES];
+    /// The number of ticks.
+    unsigned int num_ticks;
+    /// The cycles spent in the scheduler before a context switch.
+    unsigned long long costs[MAX_SAMPLES];
+    /// The number of context switches.
+    unsigned int switches;
+    /// The number of jobs released.
+    unsigned int releases;
+    /// The number of deadline misses.
+    unsigned int misses;
+    /// The number of WCET overruns.
+    unsigned int overruns;
+    /// The number of times a task inherited from a task waiting for it.
+    unsigned int inherits;
+} policy_stats_t;
+
+static policy_stats_t stats[SCHED_POLICY_COUNT];
+
+/// The time stamp of the pending wakeup of each process (0 if none).
+static unsigned long long pending[PID_SLOTS];
+
+static inline void __sort(unsigned long long *samples, unsigned int n)
+{
+    for (unsigned int i = 1; i < n; ++i) {
+        unsigned long long value = samples[i];
+        unsigned int j           = i;
+        while ((j > 0) && (samples[j - 1] > value)) {
+            samples[j] = samples[j - 1];
+            --j;
+        }
+        samples[j] = value;
+    }
+}
+
+static inline unsigned long long __percentile(unsigned long long *samples, unsigned int n, unsigned int p)
+{
+    return samples[(p * (n - 1)) / 100];
+}
+
+static inline void __account(sched_trace_event_t *event, unsigned int *lost)
+{
+    if (event->policy >= SCHED_POLICY_COUNT)
+        return;
+    policy_stats_t *policy = &stats[event->policy];
+    unsigned int slot      = (unsigned int)event->pid % PID_SLOTS;
+    switch (event->type) {
+    case SCHED_TRACE_RELEASE:
+        ++policy->releases;
+        // fall through
+    case SCHED_TRACE_WAKEUP:
+        pending[slot] = event->timestamp;
+        break;
+    case SCHED_TRACE_PICK:
+        if (policy->num_picks < MAX_SAMPLES)
+            policy->picks[policy->num_picks++] = event->data;
+        break;
+    case SCHED_TRACE_TICK:
+        if (policy->num_ticks < MAX_SAMPLES)
+            policy->ticks[policy->num_ticks++] = event->data;
+        break;
+    case SCHED_TRACE_SWITCH:
+        if (policy->switches < MAX_SAMPLES)
+            policy->costs[policy->switches] = event->data;
+        ++policy->switches;
+        if (pending[slot] && (policy->num_samples < MAX_SAMPLES))
+            policy->samples[policy->num_samples++] = event->timestamp - pending[slot];
+        pending[slot] = 0;
+        break;
+    case SCHED_TRACE_DEADLINE_MISS:
+        ++policy->misses;
+        break;
+    case SCHED_TRACE_WCET_OVERRUN:
+        ++policy->overruns;
+        break;
+    case SCHED_TRACE_INHERIT:
+        ++policy->inherits;
+        break;
+    case SCHED_TRACE_LOST:
+        *lost += event->data;
+        break;
+    default:
+        break;
+    }
+}
+
+/// @brief Reads all the records in the trace, and accounts them.
+/// @param fd    the open /proc/sched_trace.
+/// @param total the number of records read.
+/// @param lost  the number of records lost.
+static inline void __drain(int fd, unsigned int *total, unsigned int *lost)
+{
+    sched_trace_event_t events[64];
+    ssize_t ret;
+    while ((ret = read(fd, (char *)events, sizeof(events))) > 0) {
+        for (ssize_t i = 0; i < (ret / (ssize_t)sizeof(sched_trace_event_t)); ++i) {
+            __account(&events[i], lost);
+        }
+        *total += ret / sizeof(sched_trace_event_t);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = 0;
+    char *ptr;
+    if ((argc == 3) && !strcmp(argv[1], "-t")) {
+        seconds = strtol(argv[2], &ptr, 10);
+    } else if (argc != 1) {
+        printf("Usage: %s [-t seconds]\n", argv[0]);
+        return 1;
+    }
+    int fd = open("/proc/sched_trace", O_RDONLY, 0);
+    if (fd == -1) {
+        printf("%s: cannot open /proc/sched_trace: %s\n", argv[0], strerror(errno));
+        return 1;
+    }
+    unsigned int total = 0, lost = 0;
+    // The length of the sleep depends on the tick, so the run is bounded by
+    // the clock and not by the number of reads.
+    timespec interval = { .tv_sec = 0, .tv_nsec = DRAIN_INTERVAL_NS };
+    time_t end        = time(NULL) + seconds;
+    while (time(NULL) < end) {
+        __drain(fd, &total, &lost);
+        nanosleep(&interval, NULL);
+    }
+    __drain(fd, &total, &lost);
+    close(fd);
+
+    printf("%u events, %u lost, latencies in TSC cycles\n", total, lost);
+    printf("%-8s %8s %8s %10s %10s %10s %10s %7s %8s %8s\n",
+           "policy", "switches", "samples", "p50", "p90", "p99", "max", "misses", "overruns", "inherits");
+    for (int p = 0; p < SCHED_POLICY_COUNT; ++p) {
+        policy_stats_t *policy = &stats[p];
+        if ((policy->switches == 0) && (policy->misses == 0) && (policy->overruns == 0) && (policy->inherits == 0))
+            continue;
+        if (policy->num_samples == 0) {
+            printf("%-8s %8u %8u %10s %10s %10s %10s %7u %8u %8u\n",
+                   policy_names[p], policy->switches, 0, "-", "-", "-", "-", policy->misses, policy->overruns, policy->inherits);
+            continue;
+        }
+        __sort(policy->samples, policy->num_samples);
+        printf("%-8s %8u %8u %10u %10u %10u %10u %7u %8u %8u\n",
+               policy_names[p], policy->switches, policy->num_samples,
+               (unsigned int)__percentile(policy->samples, policy->num_samples, 50),
+               (unsigned int)__percentile(policy->samples, policy->num_samples, 90),
+               (unsigned int)__percentile(policy->samples, policy->num_samples, 99),
+               (unsigned int)policy->samples[policy->num_samples - 1],
+               policy->misses, policy->overruns, policy->inherits);
+    }
+
+    // The cost of the scheduler and of its tick handler, and the ratio of jobs missing their deadline,
+    // per mille: user programs have no 64-bit division.
+    printf("%-8s %8s %10s %10s %10s %10s %10s %10s %10s %8s %9s\n",
+           "policy", "picks", "pick-p50", "pick-p99", "pick-max", "sched-p50", "sched-p99", "tick-p50", "tick-p99", "jobs", "miss-pml");
+    for (int p = 0; p < SCHED_POLICY_COUNT; ++p) {
+        policy_stats_t *policy = &stats[p];
+        if (policy->num_picks == 0)
+            continue;
+        unsigned int num_costs = (policy->switches < MAX_SAMPLES) ? policy->switches : MAX_SAMPLES;
+        __sort(policy->picks, policy->num_picks);
+        __sort(policy->costs, num_costs);
+        __sort(policy->ticks, policy->num_ticks);
+        printf("%-8s %8u %10u %10u %10u %10u %10u %10u %10u %8u %9u\n",
+               policy_names[p], policy->num_picks,
+               (unsigned int)__percentile(policy->picks, policy->num_picks, 50),
+               (unsigned int)__percentile(policy->picks, policy->num_picks, 99),
+               (unsigned int)policy->picks[policy->num_picks - 1],
+               num_costs ? (unsigned int)__percentile(policy->costs, num_costs, 50) : 0,
+               num_costs ? (unsigned int)__percentile(policy->costs, num_costs, 99) : 0,
+               policy->num_ticks ? (unsigned int)__percentile(policy->ticks, policy->num_ticks, 50) : 0,
+               policy->num_ticks ? (unsigned int)__percentile(policy->ticks, policy->num_ticks, 99) : 0,
+               policy->releases,
+               policy->releases ? (policy->misses * 1000U) / policy->releases : 0);
+    }
+    return 0;
+}
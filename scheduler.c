@@ -0,0 +1,1270 @@
+/// @file scheduler.c
+/// @brief Scheduler structures and functions.
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Include the kernel log levels.
+#include "sys/kernel_levels.h"
+/// Change the header.
+#define __DEBUG_HEADER__ "[SCHED ]"
+/// Set the log level.
+#define __DEBUG_LEVEL__ LOGLEVEL_NOTICE
+
+#include "assert.h"
+#include "strerror.h"
+#include "fs/vfs.h"
+#include "process/scheduler.h"
+#include "descriptor_tables/tss.h"
+#include "devices/fpu.h"
+#include "process/prio.h"
+#include "process/wait.h"
+#include "mem/kheap.h"
+#include "system/panic.h"
+#include "io/debug.h"
+#include "time.h"
+#include "sys/errno.h"
+#include "klib/list_head.h"
+#include "mem/paging.h"
+#include "hardware/timer.h"
+#include "math.h"
+#include "stdio.h"
+#include "string.h"
+
+/// @brief          Assembly function setting the kernel stack to jump into
+///                 location in Ring 3 mode (USER mode).
+/// @param location The location where to jump.
+/// @param stack    The stack to use.
+extern void enter_userspace(uintptr_t location, uintptr_t stack);
+
+/// The lists of processes, one for each CPU.
+runqueue_t runqueues[SCHED_MAX_CPUS];
+
+/// @brief Iterates over the runqueues of all the CPUs.
+#define for_each_runqueue(rq) for (runqueue_t *rq = runqueues; rq < (runqueues + SCHED_MAX_CPUS); ++rq)
+
+/// @brief Returns the runqueue of the CPU we are running on.
+/// @return the runqueue.
+static inline runqueue_t *__this_runqueue(void)
+{
+    return &runqueues[scheduler_current_cpu()];
+}
+
+/// @brief Returns the runqueue holding the given task.
+/// @param task the task.
+/// @return the runqueue.
+static inline runqueue_t *__task_runqueue(task_struct *task)
+{
+    return &runqueues[task->se.cpu];
+}
+
+/// @brief The scheduler trace, a ring buffer with a single producer (the
+/// scheduler) and a single consumer (the reader of /proc/sched_trace), so
+/// that it does not need a lock.
+static struct {
+    /// The records.
+    sched_trace_event_t events[SCHED_TRACE_SIZE];
+    /// Counts the written records, only changed by the producer.
+    volatile unsigned int head;
+    /// Counts the read records, only changed by the consumer.
+    volatile unsigned int tail;
+    /// The events dropped since the last record that has been written.
+    unsigned int lost;
+} sched_trace;
+
+/// @brief Reads the time stamp counter.
+/// @return the value of the counter.
+static inline unsigned long long __sched_rdtsc(void)
+{
+    unsigned long long tsc;
+    __asm__ __volatile__("rdtsc"
+                         : "=A"(tsc));
+    return tsc;
+}
+
+/// @brief Writes a record in the scheduler trace, which must have room for it.
+/// @param type  the type of event.
+/// @param pid   the process the event is about.
+/// @param other another process, depending on the type of event.
+/// @param data  data depending on the type of event.
+static inline void __sched_trace_write(sched_trace_type_t type, pid_t pid, pid_t other, unsigned int data)
+{
+    sched_trace_event_t *event = &sched_trace.events[sched_trace.head & (SCHED_TRACE_SIZE - 1)];
+    event->timestamp           = __sched_rdtsc();
+    event->ticks               = timer_get_ticks();
+    event->type                = type;
+    event->policy              = __this_runqueue()->policy ? __this_runqueue()->policy->policy : 0;
+    event->pid                 = pid;
+    event->other               = other;
+    event->data                = data;
+    // The record must be complete before the consumer can see it.
+    __asm__ __volatile__("" ::: "memory");
+    ++sched_trace.head;
+}
+
+void scheduler_trace(sched_trace_type_t type, pid_t pid, pid_t other, unsigned int data)
+{
+    unsigned int used = sched_trace.head - sched_trace.tail;
+    // Keep a record free to account for the lost events.
+    if (used >= (SCHED_TRACE_SIZE - 1)) {
+        ++sched_trace.lost;
+        return;
+    }
+    if (sched_trace.lost) {
+        __sched_trace_write(SCHED_TRACE_LOST, 0, 0, sched_trace.lost);
+        sched_trace.lost = 0;
+    }
+    __sched_trace_write(type, pid, other, data);
+}
+
+ssize_t scheduler_trace_read(char *buffer, size_t size)
+{
+    ssize_t written = 0;
+    while ((sched_trace.tail != sched_trace.head) && ((size - written) >= sizeof(sched_trace_event_t))) {
+        memcpy(buffer + written, &sched_trace.events[sched_trace.tail & (SCHED_TRACE_SIZE - 1)], sizeof(sched_trace_event_t));
+        written += sizeof(sched_trace_event_t);
+        // The record must be copied before the producer can reuse it.
+        __asm__ __volatile__("" ::: "memory");
+        ++sched_trace.tail;
+    }
+    return written;
+}
+
+void scheduler_initialize()
+{
+    for_each_runqueue(runqueue)
+    {
+        runqueue->cpu = runqueue - runqueues;
+        // Initialize the runqueue list of tasks.
+        list_head_init(&runqueue->queue);
+        // Reset the current task.
+        runqueue->curr = NULL;
+        // Start with the scheduling policy selected at build time.
+        runqueue->policy = scheduler_get_default_class();
+        // Reset the number of active tasks.
+        runqueue->num_active   = 0;
+        runqueue->num_periodic = 0;
+        // No periodic task is admitted.
+        runqueue->num_admitted = 0;
+        runqueue->utilization  = 0;
+        // Initialize the server of the aperiodic tasks.
+        memset(&runqueue->cbs, 0, sizeof(sched_cbs_t));
+        runqueue->cbs.se.period          = SCHED_CBS_PERIOD;
+        runqueue->cbs.se.worst_case_exec = SCHED_CBS_BUDGET;
+        if (SCHED_CBS_PERIOD > 0)
+            runqueue->cbs.se.utilization_factor = (double)SCHED_CBS_BUDGET / (double)SCHED_CBS_PERIOD;
+        // Initialize the queue of runnable tasks.
+        list_head_init(&runqueue->runnable);
+        runqueue->num_runnable = 0;
+        // Initialize the tree of runnable tasks.
+        runqueue->cfs_tree.root     = NULL;
+        runqueue->cfs_tree.leftmost = NULL;
+        runqueue->cfs_tree.size     = 0;
+#if SCHED_HOT_SLOTS
+        // Initialize the hot scheduling fields.
+        runqueue->hot.size     = 0;
+        runqueue->hot.overflow = 0;
+#endif
+        // Initialize the trees of real-time tasks, which are shared by all
+        // the CPUs under the global scheduling.
+        runqueue->rt                  = SCHED_RT_GLOBAL ? &runqueues[0] : runqueue;
+        runqueue->rt_ready.root       = NULL;
+        runqueue->rt_ready.leftmost   = NULL;
+        runqueue->rt_ready.size       = 0;
+        runqueue->rt_release.root     = NULL;
+        runqueue->rt_release.leftmost = NULL;
+        runqueue->rt_release.size     = 0;
+    }
+}
+
+uint32_t scheduler_getpid(void)
+{
+    /// The current unused PID.
+    static unsigned long int tid = 1;
+
+    // Return the pid and increment.
+    return tid++;
+}
+
+task_struct *scheduler_get_current_process()
+{
+    return __this_runqueue()->curr;
+}
+
+vruntime_t scheduler_get_maximum_vruntime()
+{
+    vruntime_t vruntime = 0;
+    task_struct *entry;
+    runqueue_t *runqueue = __this_runqueue();
+    list_for_each_decl(it, &runqueue->queue)
+    {
+        // Check if we reached the head of list_head, and skip it.
+        if (it == &runqueue->queue)
+            continue;
+        // Get the current entry.
+        entry = list_entry(it, task_struct, run_list);
+        // Skip the process if it is a periodic one, we are issued to skip
+        // periodic tasks, and the entry is not a periodic task under
+        // analysis.
+        if (entry->se.is_periodic && !entry->se.is_under_analysis)
+            continue;
+        if (entry->se.vruntime > vruntime)
+            vruntime = entry->se.vruntime;
+    }
+    return vruntime;
+}
+
+size_t scheduler_get_active_processes()
+{
+    size_t num_active = 0;
+    for_each_runqueue(runqueue)
+    {
+        num_active += runqueue->num_active;
+    }
+    return num_active;
+}
+
+task_struct *scheduler_get_running_process(pid_t pid)
+{
+    task_struct *entry;
+    for_each_runqueue(runqueue)
+    {
+        list_for_each_decl(it, &runqueue->queue)
+        {
+            entry = list_entry(it, task_struct, run_list);
+            if (entry->pid == pid)
+                return entry;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Makes the process selectable by the scheduling algorithms.
+/// @param process the process, which must be in the state TASK_RUNNING.
+static inline void __activate_task(task_struct *process)
+{
+    // Check if the process is already runnable.
+    if (!list_head_empty(&process->runnable_list))
+        return;
+    runqueue_t *runqueue = __task_runqueue(process);
+    list_head_insert_before(&process->runnable_list, &runqueue->runnable);
+    ++runqueue->num_runnable;
+    scheduler_cfs_enqueue(runqueue, process);
+    scheduler_class_enqueue(runqueue, process);
+    // The process may have to preempt the running one at the next tick.
+    timer_restart_tick();
+}
+
+/// @brief Removes the process from the ones the scheduling algorithms can
+/// select, called whenever the process leaves the state TASK_RUNNING.
+/// @param process the process.
+static inline void __deactivate_task(task_struct *process)
+{
+    // Check if the process is actually runnable.
+    if (list_head_empty(&process->runnable_list))
+        return;
+    runqueue_t *runqueue = __task_runqueue(process);
+    list_head_remove(&process->runnable_list);
+    --runqueue->num_runnable;
+    scheduler_cfs_dequeue(runqueue, process);
+    scheduler_class_dequeue(runqueue, process);
+}
+
+/// @brief Moves the process to its place in the structures of the scheduling
+/// class, called whenever its real-time parameters change.
+/// @param process the process.
+static inline void __requeue_task(task_struct *process)
+{
+    runqueue_t *runqueue = __task_runqueue(process);
+    scheduler_class_dequeue(runqueue, process);
+    if (!list_head_empty(&process->runnable_list))
+        scheduler_class_enqueue(runqueue, process);
+    // Its next release may come before the next timer interrupt.
+    timer_restart_tick();
+}
+
+/// @brief Checks if the periodic task is admitted, i.e., it passed the
+/// admission test and it is scheduled as a periodic task.
+/// @param task the task.
+/// @return true if the task is admitted, false otherwise.
+static inline bool_t __is_admitted(task_struct *task)
+{
+    return task->se.is_periodic && !task->se.is_under_analysis;
+}
+
+/// @brief Removes the periodic task from the admitted ones, if it is there.
+/// @param task the task.
+static inline void __revoke_admission(task_struct *task)
+{
+    if (!__is_admitted(task))
+        return;
+    runqueue_t *domain = __task_runqueue(task)->rt;
+    // Avoid accumulating rounding errors once no task is admitted.
+    if (--domain->num_admitted == 0) {
+        domain->utilization = 0;
+    } else {
+        domain->utilization -= task->se.utilization_factor;
+    }
+}
+
+/// @brief Selects the runqueue of a new process, the one of the CPU with
+/// the fewest runnable processes.
+/// @return the runqueue.
+static inline runqueue_t *__select_runqueue(void)
+{
+    runqueue_t *target = __this_runqueue();
+    for_each_runqueue(runqueue)
+    {
+        if (runqueue->num_runnable < target->num_runnable)
+            target = runqueue;
+    }
+    return target;
+}
+
+void scheduler_enqueue_task(task_struct *process)
+{
+    runqueue_t *runqueue = __select_runqueue();
+    // If current_process is NULL, then process is the current process.
+    if (runqueue->curr == NULL) {
+        runqueue->curr = process;
+    }
+    // Add the new process at the end.
+    process->se.cpu = runqueue->cpu;
+    list_head_insert_before(&process->run_list, &runqueue->queue);
+    // Increment the number of active processes.
+    ++runqueue->num_active;
+    // Make the process selectable by the scheduling algorithms.
+    list_head_init(&process->runnable_list);
+    if (process->state == TASK_RUNNING) {
+        __activate_task(process);
+    }
+}
+
+void scheduler_dequeue_task(task_struct *process)
+{
+    runqueue_t *runqueue = __task_runqueue(process);
+    // Delete the process from the list of running processes.
+    list_head_remove(&process->run_list);
+    // Remove it from the runnable tasks.
+    __deactivate_task(process);
+    // Decrement the number of active processes.
+    --runqueue->num_active;
+    // Its utilization is not reserved anymore.
+    __revoke_admission(process);
+    if (process->se.is_periodic)
+        runqueue->num_periodic--;
+}
+
+/// @brief Returns the smallest vruntime among the runnable processes of the
+/// runqueue, the one the vruntime of migrating processes is relative to.
+/// @param runqueue the runqueue.
+/// @return the smallest vruntime, 0 if there are no runnable processes.
+static inline vruntime_t __min_vruntime(runqueue_t *runqueue)
+{
+    if (runqueue->cfs_tree.leftmost)
+        return runqueue->cfs_tree.leftmost->key;
+    return 0;
+}
+
+bool_t scheduler_is_running(task_struct *process)
+{
+    return __task_runqueue(process)->curr == process;
+}
+
+void scheduler_migrate_task(task_struct *process, runqueue_t *runqueue)
+{
+    runqueue_t *source = __task_runqueue(process);
+    if (source == runqueue)
+        return;
+    assert(!scheduler_is_running(process) && "Cannot migrate a running process.");
+    bool_t runnable = !list_head_empty(&process->runnable_list);
+    // Keep the distance of the vruntime from the smallest one of the queue,
+    // the vruntimes of different CPUs are not related.
+    vruntime_t min_vruntime = __min_vruntime(source);
+    __deactivate_task(process);
+    list_head_remove(&process->run_list);
+    --source->num_active;
+    if (process->se.is_periodic)
+        --source->num_periodic;
+    if (process->se.vruntime > min_vruntime)
+        process->se.vruntime = process->se.vruntime - min_vruntime + __min_vruntime(runqueue);
+    else
+        process->se.vruntime = __min_vruntime(runqueue);
+    // Move it to the other CPU.
+    process->se.cpu = runqueue->cpu;
+    list_head_insert_before(&process->run_list, &runqueue->queue);
+    ++runqueue->num_active;
+    if (process->se.is_periodic)
+        ++runqueue->num_periodic;
+    if (runnable)
+        __activate_task(process);
+}
+
+/// @brief Steals a runnable process from the CPU with the most of them, when
+/// the given one has nothing to run. Only aperiodic processes are stolen,
+/// the periodic ones have been admitted on their own CPU.
+/// @param runqueue the runqueue of the idle CPU.
+/// @return the stolen process, NULL if there is none.
+static inline task_struct *__steal_task(runqueue_t *runqueue)
+{
+    runqueue_t *busiest = NULL;
+    for_each_runqueue(it)
+    {
+        if ((it != runqueue) && (it->num_runnable > 1))
+            if ((busiest == NULL) || (it->num_runnable > busiest->num_runnable))
+                busiest = it;
+    }
+    if (busiest == NULL)
+        return NULL;
+    list_for_each_decl(it, &busiest->runnable)
+    {
+        task_struct *entry = list_entry(it, task_struct, runnable_list);
+        if ((entry != busiest->curr) && !entry->se.is_periodic) {
+            scheduler_migrate_task(entry, runqueue);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void scheduler_run(pt_regs *f)
+{
+    runqueue_t *runqueue = __this_runqueue();
+    // Check if there is a running process.
+    if (runqueue->curr == NULL)
+        return;
+
+    task_struct *next = NULL;
+    // The cost of the scheduler is measured for the trace.
+    unsigned long long start = __sched_rdtsc(), pick_start;
+
+    // Update the context of the current process.
+    scheduler_store_context(f, runqueue->curr);
+
+    // We check the existence of pending signals every time we finish
+    // handling an interrupt or an exception.
+    if (!do_signal(f)) {
+        // An idle CPU pulls work from the busiest one.
+        if (runqueue->num_runnable == 0)
+            __steal_task(runqueue);
+#if 1
+        if (runqueue->curr->state == EXIT_ZOMBIE) {
+            //==== Handle Zombies =================================================
+            //pr_debug("Handle zombie %d\n", runqueue->curr->pid);
+            // get the first runnable process, the zombie is not runnable
+            if (!list_head_empty(&runqueue->runnable)) {
+                next = list_entry(runqueue->runnable.next, task_struct, runnable_list);
+            } else {
+                // get the next process after the current one
+                list_head *nNode = runqueue->curr->run_list.next;
+                // check if we reached the head of list_head
+                if (nNode == &runqueue->queue) {
+                    nNode = nNode->next;
+                }
+                // get the task_struct
+                next = list_entry(nNode, task_struct, run_list);
+            }
+            // Remove the zombie task.
+            scheduler_dequeue_task(runqueue->curr);
+            assert(next && "No valid task selected after removing ZOMBIE.");
+            //=====================================================================
+        } else {
+#endif
+            //==== Scheduling =====================================================
+            // If we are currently executing a periodic process, and this process
+            //  has yet to complete, keep executing it.
+            if (runqueue->policy->periodic_non_preemptive)
+                if (runqueue->curr->se.is_periodic)
+                    if (!runqueue->curr->se.executed)
+                        return;
+            // Pointer to the next process to be executed.
+            pick_start = __sched_rdtsc();
+            next       = scheduler_pick_next_task(runqueue);
+            scheduler_trace(SCHED_TRACE_PICK, next->pid, 0, (unsigned int)(__sched_rdtsc() - pick_start));
+            //=====================================================================
+        }
+        // Check if the next and current processes are different.
+        if (next != runqueue->curr) {
+            scheduler_trace(SCHED_TRACE_SWITCH, next->pid, runqueue->curr->pid, (unsigned int)(__sched_rdtsc() - start));
+            // Copy into Kernel stack the next process's context.
+            scheduler_restore_context(next, f);
+        }
+    }
+    //==========================================================================
+}
+
+unsigned long scheduler_next_event(unsigned long max_ticks)
+{
+    unsigned long now = timer_get_ticks(), next = max_ticks;
+    for_each_runqueue(runqueue)
+    {
+        // When several tasks are ready they share the CPU, and the running one
+        // can be preempted at every tick. The periodic tasks waiting for their
+        // next period do not compete for the CPU.
+        size_t ready = 0;
+        list_for_each_decl(it, &runqueue->runnable)
+        {
+            task_struct *entry = list_entry(it, task_struct, runnable_list);
+            if ((entry->se.rt_tree != &runqueue->rt->rt_release) && (++ready > 1))
+                return 1;
+        }
+        // Otherwise, the earliest release is the next time the running task
+        // can be preempted.
+        sched_rb_node_t *release = runqueue->rt->rt_release.leftmost;
+        if (release) {
+            unsigned long ticks = (release->key > now) ? (unsigned long)(release->key - now) : 1;
+            if (ticks < next)
+                next = ticks;
+        }
+    }
+    return next ? next : 1;
+}
+
+/// @brief Makes the owner inherit from a waiter, without moving it.
+/// @param owner the owner of the queue.
+/// @param wait  the entry of the waiter.
+/// @return true if what the owner inherits has changed, false otherwise.
+static inline bool_t __inherit(task_struct *owner, wait_queue_entry_t *wait)
+{
+    task_struct *waiter = wait->task;
+    bool_t changed      = false;
+    if (!SCHED_INHERITANCE || (owner == waiter))
+        return false;
+    // A lower value comes first, for both the priority and the key.
+    int prio = scheduler_effective_prio(waiter);
+    if (prio < scheduler_effective_prio(owner)) {
+        owner->se.pi_prio = prio;
+        changed           = true;
+    }
+    // The key of a blocked task stays the one it had in the ready tasks.
+    if ((wait->flags & WQ_FLAG_RT_KEY) && (!owner->se.pi_key || (waiter->se.rt_node.key < owner->se.pi_key))) {
+        owner->se.pi_key = waiter->se.rt_node.key;
+        changed          = true;
+    }
+    return changed;
+}
+
+void scheduler_inherit(task_struct *owner, wait_queue_entry_t *wait)
+{
+    if (owner && __inherit(owner, wait)) {
+        __requeue_task(owner);
+        scheduler_trace(SCHED_TRACE_INHERIT, owner->pid, wait->task->pid,
+                        (wait->flags & WQ_FLAG_RT_KEY) ? (unsigned int)owner->se.pi_key : (unsigned int)owner->se.pi_prio);
+    }
+}
+
+void scheduler_reinherit(task_struct *task)
+{
+    int prio       = task->se.pi_prio;
+    vruntime_t key = task->se.pi_key;
+    // Start again from the waiters still there.
+    task->se.pi_prio = 0;
+    task->se.pi_key  = 0;
+    for (wait_queue_head_t *head = task->se.pi_owned; head; head = head->owned_next) {
+        list_for_each_decl(it, &head->task_list)
+        {
+            __inherit(task, list_entry(it, wait_queue_entry_t, task_list));
+        }
+    }
+    if ((task->se.pi_prio != prio) || (task->se.pi_key != key)) {
+        __requeue_task(task);
+    }
+}
+
+void scheduler_store_context(pt_regs *f, task_struct *process)
+{
+    // Store the registers.
+    process->thread.regs = *f;
+}
+
+void scheduler_restore_context(task_struct *process, pt_regs *f)
+{
+    // Switch to the next process.
+    __this_runqueue()->curr = process;
+    // Restore the registers.
+    *f = process->thread.regs;
+    // TODO: Explain paging switch (ring 0 doesn't need page switching)
+    // Switch to process page directory
+    paging_switch_directory_va(process->mm->pgd);
+}
+
+void scheduler_enter_user_jmp(uintptr_t location, uintptr_t stack)
+{
+    // Reset stack pointer for kernel.
+    tss_set_stack(0x10, initial_esp);
+
+    // update start execution time.
+    __this_runqueue()->curr->se.start_runtime = timer_get_ticks();
+
+    // last context switch time.
+    __this_runqueue()->curr->se.exec_start = timer_get_ticks();
+
+    // Jump in location.
+    enter_userspace(location, stack);
+}
+
+/// @brief Awakens a sleeping process.
+/// @param process The process that should be awakened
+/// @param mode The type of wait (TASK_INTERRUPTIBLE or TASK_UNINTERRUPTIBLE).
+/// @param sync Specifies if the wakeup should be synchronous.
+/// @return 1 on success, 0 on failure.
+static inline int try_to_wake_up(task_struct *process, int mode, int sync)
+{
+    // Only tasks in the state TASK_UNINTERRUPTIBLE can be woke up
+    if (process->state == TASK_UNINTERRUPTIBLE || process->state == TASK_STOPPED) {
+        //TODO: Recalc task priority
+        process->state = TASK_RUNNING;
+        // The process can be selected again.
+        __activate_task(process);
+        scheduler_trace(SCHED_TRACE_WAKEUP, process->pid, 0, 0);
+        return 1;
+    }
+    return 0;
+}
+
+int default_wake_function(wait_queue_entry_t *wait, unsigned mode, int sync)
+{
+    task_struct *p = wait->task;
+    return try_to_wake_up(p, mode, sync);
+}
+
+wait_queue_entry_t *sleep_on(wait_queue_head_t *wq)
+{
+    // Save the sleeping process registers state
+    task_struct *sleeping_task = scheduler_get_current_process();
+
+#if 0
+    pt_regs* f = get_current_interrupt_stack_frame();
+    scheduler_store_context(f, sleeping_task);
+
+    // Select next process in the runqueue as the current, restore it's context,
+    // we assume that the first process is init wich does not sleep (I hope).
+    // This is necessary to make the scheduler_run() in syscall_handler work.
+    task_struct *next = list_entry(__this_runqueue()->queue.next, task_struct, run_list);
+    assert((next != sleeping_task) && "The next selected process in the runqueue is the sleeping process");
+    scheduler_restore_context(next, f);
+#endif
+
+    wait_queue_entry_t *wait_entry = kmalloc(sizeof(struct wait_queue_entry_t));
+    init_waitqueue_entry(wait_entry, sleeping_task);
+    // The key of a ready real-time task is lost once it leaves the trees.
+    if (sleeping_task->se.rt_tree == &__task_runqueue(sleeping_task)->rt->rt_ready) {
+        wait_entry->flags |= WQ_FLAG_RT_KEY;
+    }
+
+    // Stops task from runqueue making it unrunnable
+    sleeping_task->state = TASK_UNINTERRUPTIBLE;
+    __deactivate_task(sleeping_task);
+
+    // Add sleeping process to sleep wait queue
+    add_wait_queue(wq, wait_entry);
+    // The owner of the queue runs with the priority of the waiter, so that the
+    // tasks in between cannot delay it indefinitely.
+    scheduler_inherit(wq->owner, wait_entry);
+
+    return wait_entry;
+}
+
+int is_orphaned_pgrp(pid_t pgid)
+{
+    pid_t sid = 0;
+
+    // Obtain SID of the group from a member
+    list_head *it;
+    for_each_runqueue(runqueue)
+    {
+        list_for_each (it, &runqueue->queue) {
+            task_struct *task = list_entry(it, task_struct, run_list);
+            if (task->pgid == pgid) {
+                sid = task->sid;
+                break;
+            }
+        }
+        if (sid)
+            break;
+    }
+
+    // Check if the process leader of the session is alive
+    if (scheduler_get_running_process(sid))
+        return 0;
+
+    return 1;
+}
+
+pid_t sys_getpid()
+{
+    // Get the current task.
+    if (__this_runqueue()->curr == NULL) {
+        kernel_panic("There is no current process!");
+    }
+
+    // Return the process identifer of the process.
+    return __this_runqueue()->curr->pid;
+}
+
+pid_t sys_getsid(pid_t pid)
+{
+    //If pid == 0 return SID of the calling process
+    if (pid == 0) {
+        if (__this_runqueue()->curr == NULL) {
+            kernel_panic("There is no current process!");
+        }
+        // Return the session identifer of the process.
+        return __this_runqueue()->curr->sid;
+    }
+    //If != 0 get SID of the specified process
+    task_struct *task = scheduler_get_running_process(pid);
+    if (task) {
+        if (__this_runqueue()->curr->sid != task->sid)
+            return -EPERM;
+
+        return task->sid;
+    }
+    return -ESRCH;
+}
+
+pid_t sys_setsid()
+{
+    task_struct *task = __this_runqueue()->curr;
+    if (task == NULL) {
+        kernel_panic("There is no current process!");
+    }
+    if (task->sid == task->pid) {
+        pr_debug("Process %d is already a session leader.", task->pid);
+        return -EPERM;
+    }
+
+    task->sid  = task->pid;
+    task->pgid = task->pid;
+
+    return task->sid;
+}
+
+pid_t sys_getpgid(pid_t pid)
+{
+    task_struct *task = NULL;
+    if (pid == 0)
+        task = __this_runqueue()->curr;
+    else
+        task = scheduler_get_running_process(pid);
+    if (task)
+        return task->pgid;
+    return 0;
+}
+
+int sys_setpgid(pid_t pid, pid_t pgid)
+{
+    task_struct *task = NULL;
+    if (pid == 0)
+        task = __this_runqueue()->curr;
+    else
+        task = scheduler_get_running_process(pid);
+    if (task) {
+        if (task->pgid == task->pid)
+            pr_debug("Process %d is already a session leader.", task->pid);
+        task->pgid = pgid;
+    }
+    return 0;
+}
+
+uid_t sys_getuid()
+{
+    if (__this_runqueue()->curr)
+        return __this_runqueue()->curr->uid;
+    return -EPERM;
+}
+
+int sys_setuid(uid_t uid)
+{
+    if (__this_runqueue()->curr && (__this_runqueue()->curr->uid == 0)) {
+        __this_runqueue()->curr->uid = uid;
+        return 0;
+    }
+    return -EPERM;
+}
+
+pid_t sys_getgid()
+{
+    if (__this_runqueue()->curr) {
+        return __this_runqueue()->curr->gid;
+    }
+    return -EPERM;
+}
+
+int sys_setgid(pid_t gid)
+{
+    if (__this_runqueue()->curr && (__this_runqueue()->curr->uid == 0)) {
+        __this_runqueue()->curr->gid = gid;
+        return 0;
+    }
+    return -EPERM;
+}
+
+pid_t sys_getppid()
+{
+    // Get the current task.
+    if (__this_runqueue()->curr && __this_runqueue()->curr->parent)
+        return __this_runqueue()->curr->parent->pid;
+    return -EPERM;
+}
+
+int sys_nice(int increment)
+{
+    // Get the current task.
+    if (__this_runqueue()->curr == NULL) {
+        kernel_panic("There is no current process!");
+    }
+
+    if (increment < -40) {
+        increment = -40;
+    }
+    if (increment > 40) {
+        increment = 40;
+    }
+
+    int newNice = PRIO_TO_NICE(__this_runqueue()->curr->se.prio) + increment;
+    pr_debug("New nice value would be : %d\n", newNice);
+
+    if (newNice < MIN_NICE) {
+        newNice = MIN_NICE;
+    }
+    if (newNice > MAX_NICE) {
+        newNice = MAX_NICE;
+    }
+
+    if (PRIO_TO_NICE(__this_runqueue()->curr->se.prio) != newNice && newNice >= MIN_NICE && newNice <= MAX_NICE) {
+        __this_runqueue()->curr->se.prio = NICE_TO_PRIO(newNice);
+        scheduler_hot_update(__this_runqueue(), __this_runqueue()->curr);
+    }
+    int actualNice = PRIO_TO_NICE(__this_runqueue()->curr->se.prio);
+
+    pr_debug("Actual new nice value is: %d\n", actualNice);
+
+    return actualNice;
+}
+
+pid_t sys_waitpid(pid_t pid, int *status, int options)
+{
+    // Get the current task.
+    if (__this_runqueue()->curr == NULL) {
+        kernel_panic("There is no current process!");
+    }
+
+    /* For now we do not support waiting for processes inside the given
+     * process group (pid < -1).
+     */
+    if ((pid < -1) || (pid == 0)) {
+        return -ESRCH;
+    }
+    if (pid == __this_runqueue()->curr->pid) {
+        return -ECHILD;
+    }
+    if (options != 0 && options != WNOHANG) {
+        return -EINVAL;
+    }
+#if 0
+    if (status == NULL) {
+        return -EFAULT;
+    }
+#endif
+    if (list_head_empty(&__this_runqueue()->curr->children)) {
+        return -ECHILD;
+    }
+    list_head *it;
+    list_for_each (it, &__this_runqueue()->curr->children) {
+        task_struct *entry = list_entry(it, task_struct, sibling);
+        if (entry == NULL) {
+            continue;
+        }
+        if (entry->state != EXIT_ZOMBIE) {
+            continue;
+        }
+        if ((pid > 1) && (entry->pid != pid)) {
+            continue;
+        }
+        // Save the pid to return.
+        pid_t ppid = entry->pid;
+        // Save the exit status, as set by sys_exit.
+        if (status)
+            (*status) = entry->exit_code;
+        // Finalize the VFS structures.
+        vfs_destroy_task(entry);
+        // Remove entry from children of parent.
+        list_head_remove(&entry->sibling);
+        // Remove entry from the scheduling queue.
+        scheduler_dequeue_task(entry);
+        // Delete the task_struct.
+        kmem_cache_free(entry);
+        pr_debug("Process %d is freeing memory of process %d.\n", __this_runqueue()->curr->pid, ppid);
+        return ppid;
+    }
+    return 0;
+}
+
+void sys_exit(int exit_code)
+{
+    // Get the current task.
+    if (__this_runqueue()->curr == NULL) {
+        kernel_panic("There is no current process!");
+    }
+
+    // Get the process.
+    task_struct *init_proc = scheduler_get_running_process(1);
+    if (__this_runqueue()->curr == init_proc) {
+        kernel_panic("Init process cannot call sys_exit!");
+    }
+
+    // Set the termination code of the process.
+    __this_runqueue()->curr->exit_code = (exit_code << 8) & 0xFF00;
+    // Whatever the process held goes to the tasks waiting for it.
+    while (__this_runqueue()->curr->se.pi_owned) {
+        wait_queue_unlock(__this_runqueue()->curr->se.pi_owned);
+    }
+    // Set the state of the process to zombie.
+    __this_runqueue()->curr->state = EXIT_ZOMBIE;
+    // A zombie cannot be selected anymore.
+    __deactivate_task(__this_runqueue()->curr);
+    // Send a SIGCHLD to the parent process.
+    if (__this_runqueue()->curr->parent) {
+        int ret = sys_kill(__this_runqueue()->curr->parent->pid, SIGCHLD);
+        if (ret == -1) {
+            printf("[%d] %5d failed sending signal %d : %s\n", ret, __this_runqueue()->curr->parent->pid,
+                   SIGCHLD, strerror(errno));
+        }
+    }
+
+    // If it has children, then init process has to take care of them.
+    if (!list_head_empty(&__this_runqueue()->curr->children)) {
+        pr_debug("Moving children of %s(%d) to init(%d): {\n",
+                 __this_runqueue()->curr->name, __this_runqueue()->curr->pid, init_proc->pid);
+        // Change the parent.
+        pr_debug("Moving children (%d): {\n", init_proc->pid);
+        list_for_each_decl(it, &__this_runqueue()->curr->children)
+        {
+            task_struct *entry = list_entry(it, task_struct, sibling);
+            pr_debug("    [%d] %s\n", entry->pid, entry->name);
+            entry->parent = init_proc;
+        }
+        pr_debug("}\n");
+        // Plug the list of children.
+        list_head_append(&init_proc->children, &__this_runqueue()->curr->children);
+        // Print the list of children.
+        pr_debug("New list of init children (%d): {\n", init_proc->pid);
+        list_for_each_decl(it, &init_proc->children)
+        {
+            task_struct *entry = list_entry(it, task_struct, sibling);
+            pr_debug("    [%d] %s\n", entry->pid, entry->name);
+        }
+        pr_debug("}\n");
+    }
+    // Free the space occupied by the stack.
+    destroy_process_image(__this_runqueue()->curr->mm);
+    // Debugging message.
+    pr_debug("Process %d exited with value %d\n", __this_runqueue()->curr->pid, exit_code);
+}
+
+int sys_sched_setparam(pid_t pid, const sched_param_t *param)
+{
+    // Iter over the runqueues to find the task
+    task_struct *entry = scheduler_get_running_process(pid);
+    if (entry == NULL)
+        return -1;
+    // The process must pass the admission test again.
+    __revoke_admission(entry);
+    if (!entry->se.is_periodic && param->is_periodic)
+        __task_runqueue(entry)->num_periodic++;
+    else if (entry->se.is_periodic && !param->is_periodic)
+        __task_runqueue(entry)->num_periodic--;
+    // Sets the parameters from param to the "se" struct parameters.
+    entry->se.prio        = param->sched_priority;
+    entry->se.period      = param->period;
+    entry->se.arrivaltime = param->arrivaltime;
+    entry->se.is_periodic = param->is_periodic;
+    entry->se.deadline    = timer_get_ticks() + param->deadline;
+    entry->se.next_period = timer_get_ticks();
+
+    entry->se.is_under_analysis = true;
+    entry->se.executed          = false;
+    entry->se.job_exec_runtime  = 0;
+    // Update its place among the real-time tasks.
+    __requeue_task(entry);
+    return 1;
+}
+
+int sys_sched_getparam(pid_t pid, sched_param_t *param)
+{
+    // Iter over the runqueues to find the task
+    task_struct *entry = scheduler_get_running_process(pid);
+    if (entry == NULL)
+        return -1;
+    //Sets the parameters from the "se" struct to param
+    param->sched_priority = entry->se.prio;
+    param->period         = entry->se.period;
+    param->deadline       = entry->se.deadline;
+    param->arrivaltime    = entry->se.arrivaltime;
+    return 1;
+}
+
+int scheduler_set_policy(sched_policy_t policy)
+{
+    const sched_class_t *sched_class = scheduler_get_class(policy);
+    if (sched_class == NULL)
+        return -EINVAL;
+    if (sched_class == __this_runqueue()->policy)
+        return 0;
+    // Move the runnable tasks from the structures of the old class to the
+    // ones of the new class, on all the CPUs (the real-time trees can be
+    // shared, so they must be emptied everywhere before being filled again).
+    for_each_runqueue(runqueue)
+    {
+        list_for_each_decl(it, &runqueue->runnable)
+        {
+            task_struct *entry = list_entry(it, task_struct, runnable_list);
+            scheduler_class_dequeue(runqueue, entry);
+            // The inherited keys belong to the old class.
+            entry->se.pi_key = 0;
+        }
+        runqueue->policy = sched_class;
+    }
+    for_each_runqueue(runqueue)
+    {
+        list_for_each_decl(it, &runqueue->runnable)
+        {
+            scheduler_class_enqueue(runqueue, list_entry(it, task_struct, runnable_list));
+        }
+    }
+    pr_notice("Switched to the `%s` scheduling policy.\n", sched_class->name);
+    return 0;
+}
+
+sched_policy_t scheduler_get_policy()
+{
+    return __this_runqueue()->policy->policy;
+}
+
+/// @brief Performs the exact response time analysis of the admitted periodic
+/// tasks of the CPU of the given one, plus the given one, for the RM (implicit
+/// deadlines).
+/// @param task the task to admit, with its new WCET.
+/// @return 1 if some task can miss its deadline, 0 otherwise.
+static int __response_time_analysis(task_struct *task)
+{
+    task_struct *entry, *previous;
+    time_t r, previous_r = 0;
+    runqueue_t *runqueue = __task_runqueue(task);
+    list_for_each_decl(it, &runqueue->queue)
+    {
+        // Get the curent entry in the list.
+        entry = list_entry(it, task_struct, run_list);
+        // Only the admitted processes and the new one are analysed.
+        if ((entry != task) && !__is_admitted(entry))
+            continue;
+        // Put r equal to worst case exec because is the first point in time
+        // that the task could possibly complete.
+        r = entry->se.worst_case_exec, previous_r = 0;
+        // The analysis can be completed either missing the deadline (the end
+        // of the period) or reaching a fixed point.
+        while ((r <= entry->se.period) && (r != previous_r)) {
+            // Save the previous response time.
+            previous_r = r;
+            // Initialize response time.
+            r = entry->se.worst_case_exec;
+            list_for_each_decl(it2, &runqueue->queue)
+            {
+                previous = list_entry(it2, task_struct, run_list);
+                if ((previous != task) && !__is_admitted(previous))
+                    continue;
+                // Check the interferences of higher priority processes.
+                if (previous->se.period < entry->se.period) {
+                    pr_debug("%d += (%.2f / %.2f) * %d\n",
+                             r,
+                             (double)previous_r,
+                             (double)previous->se.period,
+                             previous->se.worst_case_exec);
+
+                    // Update the response time.
+                    r += (int)ceil((double)previous_r / (double)previous->se.period) * previous->se.worst_case_exec;
+
+                    pr_debug("Response Time Analysis -> [%s] vs [%s] R = %d\n\n", entry->name, previous->name, r);
+                }
+            }
+        }
+        // Feasibility of scheduler is guaranteed if and only if response time
+        // analysis is lower than deadline.
+        if (r > entry->se.period)
+            return 1;
+    }
+    return 0;
+}
+
+/// @brief Checks if the admitted periodic tasks, together with the given one,
+/// can be scheduled by the global scheduling on more CPUs. The tests are only
+/// sufficient ones, based on the largest utilization factor of a task.
+/// @param task   the task to admit.
+/// @param u      the utilization factor of the task.
+/// @param total  the utilization factor of the admitted tasks plus the task.
+/// @param policy the policy in use.
+/// @return true if the task can be admitted, false otherwise.
+static bool_t __global_admission_test(task_struct *task, double u, double total, sched_policy_t policy)
+{
+    double cpus  = SCHED_MAX_CPUS;
+    double u_max = u;
+    for_each_runqueue(runqueue)
+    {
+        list_for_each_decl(it, &runqueue->queue)
+        {
+            task_struct *entry = list_entry(it, task_struct, run_list);
+            if ((entry != task) && __is_admitted(entry) && (entry->se.utilization_factor > u_max))
+                u_max = entry->se.utilization_factor;
+        }
+    }
+    if ((policy == SCHED_POLICY_EDF) && (u_max < runqueues[0].cbs.se.utilization_factor))
+        u_max = runqueues[0].cbs.se.utilization_factor;
+    pr_warning("Utilization factor is : %.2f, Maximum: %.2f\n", total, u_max);
+    // Goossens, Funk and Baruah bound for the global EDF.
+    if ((policy == SCHED_POLICY_EDF) || (policy == SCHED_POLICY_LLF))
+        return total <= (cpus - (cpus - 1) * u_max);
+    // Bertogna, Cirinei and Lipari bound for the global RM.
+    if (policy == SCHED_POLICY_RM)
+        return total <= ((cpus / 2) * (1 - u_max) + u_max);
+    // The other policies do not give guarantees to periodic processes.
+    return true;
+}
+
+/// @brief Checks if the admitted periodic tasks, together with the given one,
+/// can be scheduled by the policy in use.
+/// @param task the task to admit, with its new WCET (it can be already
+/// admitted, with the old one).
+/// @param u    the utilization factor of the task.
+/// @return true if the task can be admitted, false otherwise.
+static bool_t __admission_test(task_struct *task, double u)
+{
+    runqueue_t *domain = __task_runqueue(task)->rt;
+    // The totals without the task, plus the task.
+    double total = domain->utilization + u;
+    size_t n    = domain->num_admitted + 1;
+    if (__is_admitted(task)) {
+        total -= task->se.utilization_factor;
+        n -= 1;
+    }
+    sched_policy_t policy = domain->policy->policy;
+    // Under the EDF, the bandwidth of the aperiodic servers is reserved.
+    if (policy == SCHED_POLICY_EDF)
+        total += (SCHED_RT_GLOBAL ? SCHED_MAX_CPUS : 1) * domain->cbs.se.utilization_factor;
+    // The tasks of the global scheduling can run on all the CPUs.
+    if (SCHED_RT_GLOBAL && (SCHED_MAX_CPUS > 1))
+        return __global_admission_test(task, u, total, policy);
+    if ((policy == SCHED_POLICY_EDF) || (policy == SCHED_POLICY_LLF)) {
+        pr_warning("Utilization factor is : %.2f\n", total);
+        // If the utilization factor is above 1, the process cannot be placed
+        // with the other periodic processes.
+        return total <= 1;
+    }
+    if (policy == SCHED_POLICY_RM) {
+        // Calculating Least Upper Bound of utilization factor. For large amount
+        // of processes ulub asymptotically should reach ln(2).
+        double ulub = (n * (pow(2, (1.0 / n)) - 1));
+        pr_warning("Utilization factor is : %.2f, Least Upper Bound: %.2f\n", total, ulub);
+        // If the sum of utilization factor is bounded between ulub and 1 we
+        // need to calculate the response time analysis for each process.
+        if (total > 1)
+            return false;
+        if (total <= ulub)
+            return true;
+        return !__response_time_analysis(task);
+    }
+    // The other policies do not give guarantees to periodic processes.
+    return true;
+}
+
+/// @brief Adds the periodic task to the admitted ones, or updates its
+/// utilization factor if it is already admitted.
+/// @param task the task.
+/// @param u    the utilization factor of the task.
+static inline void __admit_task(task_struct *task, double u)
+{
+    runqueue_t *domain = __task_runqueue(task)->rt;
+    if (__is_admitted(task)) {
+        domain->utilization -= task->se.utilization_factor;
+    } else {
+        ++domain->num_admitted;
+        task->se.is_under_analysis = false;
+    }
+    domain->utilization += u;
+    task->se.utilization_factor = u;
+}
+
+/// @brief Turns the periodic task which failed the admission test into an
+/// aperiodic one.
+/// @param task the task.
+static inline void __demote_task(task_struct *task)
+{
+    pr_warning("Process %d (%s) is not schedulable, it becomes aperiodic.\n", task->pid, task->name);
+    __revoke_admission(task);
+    task->se.is_periodic       = false;
+    task->se.is_under_analysis = false;
+    __task_runqueue(task)->num_periodic--;
+    __requeue_task(task);
+}
+
+int sys_waitperiod()
+{
+    // Get the current process.
+    task_struct *current = scheduler_get_current_process();
+    // Check if there is actually a process running.
+    if (current == NULL) {
+        pr_emerg("There is no current process.\n");
+        return -ESRCH;
+    }
+    // Check if the process calling the waitperiod function is a periodic process.
+    if (!current->se.is_periodic) {
+        pr_warning("An aperiodic task is calling `waitperiod`, ignoring...\n");
+        return -EPERM;
+    }
+    // Get the current time.
+    time_t current_time = timer_get_ticks();
+
+    // If the task is under analysis, we need to test if the process can be
+    // placed with the other periodic tasks.
+    if (current->se.is_under_analysis) {
+        // Set the WCET as the total execution time of the process.
+        current->se.worst_case_exec = current->se.sum_exec_runtime;
+        double u = ((double)current->se.worst_case_exec / (double)current->se.period);
+        // If it is not schedulable, we need to tell it to the process.
+        if (!__admission_test(current, u)) {
+            __demote_task(current);
+            return -ENOTSCHEDULABLE;
+        }
+        // Otherwise, it is schedulable and thus it is not under analysis
+        // anymore.
+        __admit_task(current, u);
+        // The task has been executed as non-periodic process so that his
+        // deadline is not been updated by the scheduling algorithm of periodic
+        // tasks. We need to update it manually.
+        current->se.next_period = current_time;
+        current->se.deadline    = current_time + current->se.period;
+    } else {
+        // Update the Worst Case Execution Time (WCET).
+        time_t wcet = current_time - current->se.exec_start;
+        if (current->se.worst_case_exec < wcet) {
+            scheduler_trace(SCHED_TRACE_WCET_OVERRUN, current->pid, 0, wcet);
+            current->se.worst_case_exec = wcet;
+            // The utilization factor grew, check that the task still fits.
+            double u = ((double)current->se.worst_case_exec / (double)current->se.period);
+            if (!__admission_test(current, u)) {
+                __demote_task(current);
+                return -ENOTSCHEDULABLE;
+            }
+            __admit_task(current, u);
+        }
+    }
+    // If the current time is ahead of the deadline, we need to print a warning.
+    if (current_time > current->se.deadline) {
+        pr_warning("%d > %d Missing deadline...\n", current_time, current->se.deadline);
+        scheduler_trace(SCHED_TRACE_DEADLINE_MISS, current->pid, 0, current_time - current->se.deadline);
+    }
+    // Tell the scheduler that we have executed the periodic process.
+    current->se.executed = true;
+    // Wait for the next period in the release queue.
+    __requeue_task(current);
+    return 0;
+}
@@ -0,0 +1,417 @@
+/// @file scheduler.h
+/// @brief Scheduler structures and functions.
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+#pragma once
+
+#include "klib/list_head.h"
+#include "process/process.h"
+#include "process/wait.h"
+#include "stddef.h"
+
+#ifndef SCHED_MAX_CPUS
+/// @brief Number of CPUs the scheduler keeps a runqueue for.
+#define SCHED_MAX_CPUS 1
+#endif
+
+/// @brief Returns the index of the CPU we are running on, used to select its
+/// runqueue (there is only the boot CPU until the others are brought up).
+#ifndef scheduler_current_cpu
+#define scheduler_current_cpu() 0U
+#endif
+
+#ifndef SCHED_RT_GLOBAL
+/// @brief Selects the global scheduling of the real-time tasks (1), where all
+/// the CPUs share the same real-time trees and the tasks migrate to the CPU
+/// picking them, instead of the partitioned one (0), where the tasks stay on
+/// the CPU they have been placed on and each CPU admits its own tasks.
+#define SCHED_RT_GLOBAL 0
+#endif
+
+#ifndef LLF_QUANTUM
+/// @brief Laxity difference, in ticks, a task needs over the running one to
+/// preempt it under the LLF, which keeps tasks with close laxities from
+/// switching at every tick (0 gives the plain LLF).
+#define LLF_QUANTUM 2
+#endif
+
+#ifndef SCHED_CBS_PERIOD
+/// @brief Period, in ticks, of the Constant Bandwidth Server serving the
+/// aperiodic tasks under the EDF (0 disables the server).
+#define SCHED_CBS_PERIOD 50
+#endif
+
+#ifndef SCHED_CBS_BUDGET
+/// @brief Budget, in ticks, of the Constant Bandwidth Server in each period.
+#define SCHED_CBS_BUDGET 5
+#endif
+
+#ifndef SCHED_INHERITANCE
+/// @brief Makes the owners of the wait queues inherit the priority, or the
+/// real-time key, of their waiters (0 disables it, to measure the priority
+/// inversion it bounds with the lock workload of schedbench).
+#define SCHED_INHERITANCE 1
+#endif
+
+#ifndef SCHED_HOT_SLOTS
+/// @brief Number of runnable tasks of each runqueue whose hot scheduling fields
+/// are packed in arrays (0 disables them, and the pickers read the fields from
+/// the tasks along the runnable queue).
+#define SCHED_HOT_SLOTS 1024
+#endif
+
+#if SCHED_HOT_SLOTS
+/// @brief The scheduling fields read by the Round Robin and the static
+/// priority pickers, packed in arrays indexed by slot, so that a pick scans
+/// contiguous memory instead of following the runnable queue across the
+/// tasks. The slots are only kept while one of these classes is in use, they
+/// are filled in the order the tasks become runnable, and the slot freed by a
+/// task is taken by the one in the last slot.
+typedef struct sched_hot_t {
+    /// The static priority of the task in each slot.
+    int prio[SCHED_HOT_SLOTS];
+    /// Tells if the task in each slot is an admitted periodic task.
+    bool_t periodic[SCHED_HOT_SLOTS];
+    /// The task in each slot.
+    task_struct *task[SCHED_HOT_SLOTS];
+    /// The number of slots in use.
+    size_t size;
+    /// The number of runnable tasks left without a slot, while there are any
+    /// the pickers go back to the runnable queue.
+    size_t overflow;
+} sched_hot_t;
+#endif
+
+/// @brief Red-black tree of scheduling entities, which caches its leftmost
+/// (i.e., smallest) node.
+typedef struct sched_rb_root_t {
+    /// The root of the tree.
+    sched_rb_node_t *root;
+    /// The leftmost node of the tree.
+    sched_rb_node_t *leftmost;
+    /// The number of nodes in the tree.
+    size_t size;
+} sched_rb_root_t;
+
+/// @brief The scheduling policies, which can be switched at runtime.
+typedef enum sched_policy_t {
+    SCHED_POLICY_RR,       ///< Round Robin.
+    SCHED_POLICY_PRIORITY, ///< Static priority.
+    SCHED_POLICY_CFS,      ///< Completely Fair Scheduler.
+    SCHED_POLICY_EDF,      ///< Earliest Deadline First, for periodic tasks.
+    SCHED_POLICY_RM,       ///< Rate Monotonic, for periodic tasks.
+    SCHED_POLICY_AEDF,     ///< Aperiodic Earliest Deadline First.
+    SCHED_POLICY_LLF,      ///< Least Laxity First, for periodic tasks.
+    SCHED_POLICY_COUNT     ///< The number of scheduling policies.
+} sched_policy_t;
+
+struct runqueue_t;
+
+/// @brief A scheduling class, i.e., the operations implementing a scheduling
+/// algorithm (in scheduler_algorithm.c).
+typedef struct sched_class_t {
+    /// The name of the class.
+    const char *name;
+    /// The policy implemented by the class.
+    sched_policy_t policy;
+    /// Keeps running a periodic task until it has executed in its period.
+    bool_t periodic_non_preemptive;
+    /// Picks the next task, returns NULL if the class has no task to run.
+    task_struct *(*pick_next_task)(struct runqueue_t *runqueue);
+    /// Adds a runnable task to the structures of the class (can be NULL).
+    void (*enqueue_task)(struct runqueue_t *runqueue, task_struct *task);
+    /// Removes a task from the structures of the class (can be NULL).
+    void (*dequeue_task)(struct runqueue_t *runqueue, task_struct *task);
+    /// Accounts the execution of the current task, called before picking the
+    /// next one (can be NULL).
+    void (*task_tick)(struct runqueue_t *runqueue, task_struct *task);
+    /// The class tried when this one has no task to run (can be NULL).
+    const struct sched_class_t *next;
+} sched_class_t;
+
+/// @brief Constant Bandwidth Server, which serves the aperiodic tasks inside
+/// the EDF schedule with a reserved bandwidth, competing with the periodic
+/// tasks through its own deadline.
+typedef struct sched_cbs_t {
+    /// The server parameters: the period, the deadline, the maximum budget
+    /// (as worst_case_exec) and the bandwidth (as utilization_factor).
+    sched_entity_t se;
+    /// The budget left to the server.
+    int budget;
+    /// Tells if the server has aperiodic tasks to serve.
+    bool_t active;
+    /// Tells if the running task has been picked by the server.
+    bool_t running;
+} sched_cbs_t;
+
+/// @brief Structure that contains information about the live processes of a
+/// CPU.
+typedef struct runqueue_t {
+    /// The CPU owning the runqueue.
+    unsigned int cpu;
+    /// Number of queued processes.
+    size_t num_active;
+    /// Number of queued periodic processes.
+    size_t num_periodic;
+    /// Number of periodic processes which passed the admission test, in the
+    /// real-time domain of the runqueue.
+    size_t num_admitted;
+    /// Total utilization factor of the admitted periodic processes, in the
+    /// real-time domain of the runqueue.
+    double utilization;
+    /// Queue of processes.
+    list_head queue;
+    /// Queue of the processes in the state TASK_RUNNING, the only ones the
+    /// scheduling algorithms look at.
+    list_head runnable;
+    /// Number of runnable processes.
+    size_t num_runnable;
+    /// Runnable processes sorted by vruntime, for the CFS.
+    sched_rb_root_t cfs_tree;
+    /// The runqueue owning the real-time trees and the admitted utilization
+    /// used by this one: itself when the scheduling is partitioned, the one
+    /// of the first CPU when it is global (see SCHED_RT_GLOBAL).
+    struct runqueue_t *rt;
+    /// Runnable real-time processes that can be executed, sorted by
+    /// deadline (by period for the RM).
+    sched_rb_root_t rt_ready;
+    /// Runnable periodic processes which have been executed in their current
+    /// period, sorted by the start of their next period.
+    sched_rb_root_t rt_release;
+    /// The current running process.
+    task_struct *curr;
+    /// The scheduling class in use.
+    const sched_class_t *policy;
+    /// The server of the aperiodic tasks under the EDF.
+    sched_cbs_t cbs;
+#if SCHED_HOT_SLOTS
+    /// The hot scheduling fields of the runnable processes.
+    sched_hot_t hot;
+#endif
+} runqueue_t;
+
+/// @brief Number of records of the scheduler trace, a power of two.
+#define SCHED_TRACE_SIZE 1024
+
+/// @brief Types of the events of the scheduler trace.
+typedef enum sched_trace_type_t {
+    SCHED_TRACE_PICK,          ///< A task has been picked, data: the cycles spent picking it.
+    SCHED_TRACE_SWITCH,        ///< Switch to pid, from other, data: the cycles spent in the scheduler.
+    SCHED_TRACE_WAKEUP,        ///< A task has been woken up.
+    SCHED_TRACE_RELEASE,       ///< A new period started, data: the deadline.
+    SCHED_TRACE_DEADLINE_MISS, ///< A job ended late, data: the lateness.
+    SCHED_TRACE_WCET_OVERRUN,  ///< A job ran past the WCET, data: the new WCET.
+    SCHED_TRACE_INHERIT,       ///< pid inherits from the waiter other, data: the priority, or the real-time key.
+    SCHED_TRACE_TICK,          ///< The statistics of the running task have been updated, data: the cycles spent.
+    SCHED_TRACE_LOST           ///< Events lost because the trace was full, data: how many.
+} sched_trace_type_t;
+
+/// @brief A record of the scheduler trace, /proc/sched_trace returns them in
+/// binary form.
+typedef struct sched_trace_event_t {
+    /// Time stamp counter of the event.
+    unsigned long long timestamp;
+    /// Ticks of the event.
+    unsigned int ticks;
+    /// The type of the event (sched_trace_type_t).
+    unsigned short type;
+    /// The scheduling policy in use (sched_policy_t).
+    unsigned short policy;
+    /// The process the event is about.
+    pid_t pid;
+    /// Another process, depending on the type of event.
+    pid_t other;
+    /// Data depending on the type of event.
+    unsigned int data;
+} sched_trace_event_t;
+
+/// @brief Structure that describes scheduling parameters.
+typedef struct sched_param_t {
+    /// Static execution priority.
+    int sched_priority;
+    /// Expected period of the task
+    time_t period;
+    /// Absolute deadline
+    time_t deadline;
+    /// Absolute time of arrival of the task
+    time_t arrivaltime;
+    /// Is task periodic?
+    bool_t is_periodic;
+} sched_param_t;
+
+/// @brief Initialize the scheduler.
+void scheduler_initialize();
+
+/// @brief  Returns a non-decreasing unique process id.
+/// @return Process identifier (PID).
+uint32_t scheduler_getpid();
+
+/// @brief Returns the pointer to the current active process.
+/// @return Pointer to the current process.
+task_struct *scheduler_get_current_process();
+
+/// @brief Returns the maximum vruntime of all the processes in running state.
+/// @return A maximum vruntime value.
+vruntime_t scheduler_get_maximum_vruntime();
+
+/// @brief Moves the process to the runqueue of another CPU.
+/// @param process The process, which must not be running.
+/// @param runqueue The runqueue of the destination CPU.
+void scheduler_migrate_task(task_struct *process, runqueue_t *runqueue);
+
+/// @brief Checks if the process is the one running on its CPU.
+/// @param process The process.
+/// @return true if the process is running, false otherwise.
+bool_t scheduler_is_running(task_struct *process);
+
+/// @brief Returns the number of active processes.
+/// @return Number of processes.
+size_t scheduler_get_active_processes();
+
+/// @brief Returns a pointer to the process with the given pid.
+/// @param pid The pid of the process we are looking for.
+/// @return Pointer to the process, or NULL if we cannot find it.
+task_struct *scheduler_get_running_process(pid_t pid);
+
+/// @brief Activate the given process.
+/// @param process Process that has to be activated.
+void scheduler_enqueue_task(task_struct *process);
+
+/// @brief Removes the given process from the queue.
+/// @param process Process that has to be activated.
+void scheduler_dequeue_task(task_struct *process);
+
+/// @brief The RR implementation of the scheduler.
+/// @param f The context of the process.
+void scheduler_run(pt_regs *f);
+
+/// @brief Returns when the scheduler needs to run again, used to stop the
+/// periodic tick while no task can be preempted.
+/// @param max_ticks The most ticks the caller can wait.
+/// @return The ticks from now, between 1 and max_ticks.
+unsigned long scheduler_next_event(unsigned long max_ticks);
+
+/// @brief Makes the owner of a wait queue inherit the priority, or the
+/// real-time key, of a task blocking on the queue, if it comes before its own.
+/// @param owner The owner of the queue, NULL if none.
+/// @param wait  The entry of the blocking task.
+void scheduler_inherit(task_struct *owner, struct wait_queue_entry_t *wait);
+
+/// @brief Recomputes what the task inherits from the waiters of all the
+/// queues it owns, called when a waiter leaves or a queue changes owner.
+/// @param task The task.
+void scheduler_reinherit(task_struct *task);
+
+/// @brief Values from pt_regs to task_struct process.
+/// @param f       The set of registers we are saving.
+/// @param process The process for which we are saving the CPU registers status.
+void scheduler_store_context(pt_regs *f, task_struct *process);
+
+/// @brief Values from task_struct process to pt_regs.
+/// @param process The process for which we are restoring the registers in CPU .
+/// @param f       The set of registers we are restoring.
+void scheduler_restore_context(task_struct *process, pt_regs *f);
+
+/// @brief Switch CPU to user mode and start running that given process.
+/// @param location The instruction pointer of the process we are starting.
+/// @param stack    Address of the stack of that process.
+void scheduler_enter_user_jmp(uintptr_t location, uintptr_t stack);
+
+/// @brief Picks the next task (in scheduler_algorithm.c).
+/// @param runqueue   Pointer to the runqueue.
+/// @return The next task to execute.
+task_struct *scheduler_pick_next_task(runqueue_t *runqueue);
+
+/// @brief Adds a runnable task to the CFS tree (in scheduler_algorithm.c), if
+/// it is not already there.
+/// @param runqueue Pointer to the runqueue.
+/// @param task     The task to add.
+void scheduler_cfs_enqueue(runqueue_t *runqueue, task_struct *task);
+
+/// @brief Removes a task from the CFS tree (in scheduler_algorithm.c), if it
+/// is there.
+/// @param runqueue Pointer to the runqueue.
+/// @param task     The task to remove.
+void scheduler_cfs_dequeue(runqueue_t *runqueue, task_struct *task);
+
+/// @brief Copies the priority and the kind of a runnable task into its slot
+/// of the hot scheduling fields, if it has one (in scheduler_algorithm.c),
+/// called whenever they change outside of a requeue.
+/// @param runqueue Pointer to the runqueue.
+/// @param task     The task.
+void scheduler_hot_update(runqueue_t *runqueue, task_struct *task);
+
+/// @brief Returns the priority the task is scheduled with, the inherited one
+/// if it comes before its own (in scheduler_algorithm.c).
+/// @param task The task.
+/// @return The priority.
+int scheduler_effective_prio(task_struct *task);
+
+/// @brief Adds a runnable task to the structures of the scheduling class in
+/// use (in scheduler_algorithm.c), if it is not already there.
+/// @param runqueue Pointer to the runqueue.
+/// @param task     The task to add.
+void scheduler_class_enqueue(runqueue_t *runqueue, task_struct *task);
+
+/// @brief Removes a task from the structures of the scheduling class in use
+/// (in scheduler_algorithm.c), if it is there.
+/// @param runqueue Pointer to the runqueue.
+/// @param task     The task to remove.
+void scheduler_class_dequeue(runqueue_t *runqueue, task_struct *task);
+
+/// @brief Returns the scheduling class implementing the given policy (in
+/// scheduler_algorithm.c).
+/// @param policy The policy.
+/// @return The scheduling class, NULL if the policy is not valid.
+const sched_class_t *scheduler_get_class(sched_policy_t policy);
+
+/// @brief Returns the scheduling class selected at build time (in
+/// scheduler_algorithm.c).
+/// @return The scheduling class.
+const sched_class_t *scheduler_get_default_class();
+
+/// @brief Adds an event to the scheduler trace, the event is dropped (and
+/// accounted for) if the trace is full.
+/// @param type  The type of event.
+/// @param pid   The process the event is about.
+/// @param other Another process, depending on the type of event.
+/// @param data  Data depending on the type of event.
+void scheduler_trace(sched_trace_type_t type, pid_t pid, pid_t other, unsigned int data);
+
+/// @brief Moves the oldest events of the scheduler trace to the buffer.
+/// @param buffer The buffer.
+/// @param size   The size of the buffer.
+/// @return The number of bytes written, a multiple of sizeof(sched_trace_event_t).
+ssize_t scheduler_trace_read(char *buffer, size_t size);
+
+/// @brief Switches the scheduling policy.
+/// @param policy The new policy.
+/// @return 0 on success, -EINVAL if the policy is not valid.
+int scheduler_set_policy(sched_policy_t policy);
+
+/// @brief Returns the scheduling policy in use.
+/// @return The policy.
+sched_policy_t scheduler_get_policy();
+
+/// @brief Set new scheduling settings for the given process.
+/// @param pid   ID of the process we are manipulating.
+/// @param param New parameters.
+/// @return 1 on success, -1 on error.
+int sys_sched_setparam(pid_t pid, const sched_param_t *param);
+
+/// @brief Gets the scheduling settings for the given process.
+/// @param pid   ID of the process we are manipulating.
+/// @param param Where we store the parameters.
+/// @return 1 on success, -1 on error.
+int sys_sched_getparam(pid_t pid, sched_param_t *param);
+
+/// @brief Puts the process on wait until its next period starts.
+/// @return 0 on success, a negative value on failure.
+int sys_waitperiod();
+
+/// @brief Returns 1 if the given group is orphaned, the session leader of the group
+/// is no longer alive.
+/// @param gid ID of the group
+/// @return 1 if the group is orphan, 0 otherwise.
+int is_orphaned_pgrp(pid_t gid);
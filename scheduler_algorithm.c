@@ -19,10 +19,29 @@
 #include "process/wait.h"
 #include "process/scheduler.h"
 #include "limits.h"
+#include "string.h"
+
+/// Weight the vruntime with the division in double it used before the
+/// inverse-weight table, to compare the cycles of the two through the
+/// SCHED_TRACE_TICK records of /proc/sched_trace.
+#ifndef SCHED_WEIGHT_WITH_FPU
+#define SCHED_WEIGHT_WITH_FPU 0
+#endif
+
+/// @brief Reads the time stamp counter.
+/// @return the value of the counter.
+static inline unsigned long long __sched_rdtsc(void)
+{
+    unsigned long long tsc;
+    __asm__ __volatile__("rdtsc"
+                         : "=A"(tsc));
+    return tsc;
+}
 
 /// @brief Updates task execution statistics.
-/// @param task the task to update.
-static void __update_task_statistics(task_struct *task);
+/// @param runqueue the runqueue of the task.
+/// @param task     the task to update.
+static void __update_task_statistics(runqueue_t *runqueue, task_struct *task);
 
 /// @brief Checks if the given task is actually a periodic task.
 /// @param task the task to check.
@@ -33,6 +52,590 @@ static inline bool_t __is_periodic_task(task_struct *task)
     return task->se.is_periodic && !task->se.is_under_analysis;
 }
 
+int scheduler_effective_prio(task_struct *task)
+{
+    // A lower value is a higher priority.
+    if (task->se.pi_prio && (task->se.pi_prio < task->se.prio))
+        return task->se.pi_prio;
+    return task->se.prio;
+}
+
+/// @brief Returns the node the runnable tasks should be scanned from, so that
+/// the scan begins right after the current task, if it is still runnable.
+/// @param runqueue the runqueue.
+/// @return the node of the runnable queue to start from.
+static inline list_head *__runnable_start(runqueue_t *runqueue)
+{
+    if (list_head_empty(&runqueue->curr->runnable_list))
+        return &runqueue->runnable;
+    return &runqueue->curr->runnable_list;
+}
+
+/// @brief Returns the task to run when there are no runnable tasks.
+/// @param runqueue the runqueue.
+/// @return the first task of the queue.
+static inline task_struct *__no_runnable_task(runqueue_t *runqueue)
+{
+    return list_entry(runqueue->queue.next, struct task_struct, run_list);
+}
+
+/// @brief Color of a red node of the tree.
+#define SCHED_RB_RED 0
+/// @brief Color of a black node of the tree.
+#define SCHED_RB_BLACK 1
+
+/// @brief Returns the task owning the given node of the CFS tree.
+#define CFS_TASK(node) list_entry(node, task_struct, se.run_node)
+
+/// @brief Replaces the child of a node, or the root of the tree.
+/// @param tree   the tree.
+/// @param parent the parent of the child, NULL if the child is the root.
+/// @param old    the old child.
+/// @param node   the new child.
+static inline void __rb_replace_child(sched_rb_root_t *tree, sched_rb_node_t *parent, sched_rb_node_t *old, sched_rb_node_t *node)
+{
+    if (parent == NULL) {
+        tree->root = node;
+    } else if (parent->left == old) {
+        parent->left = node;
+    } else {
+        parent->right = node;
+    }
+}
+
+/// @brief Rotates the subtree rooted in node to the left.
+/// @param tree the tree.
+/// @param node the root of the subtree, which must have a right child.
+static void __rb_rotate_left(sched_rb_root_t *tree, sched_rb_node_t *node)
+{
+    sched_rb_node_t *pivot = node->right;
+    node->right            = pivot->left;
+    if (pivot->left) {
+        pivot->left->parent = node;
+    }
+    pivot->parent = node->parent;
+    __rb_replace_child(tree, node->parent, node, pivot);
+    pivot->left  = node;
+    node->parent = pivot;
+}
+
+/// @brief Rotates the subtree rooted in node to the right.
+/// @param tree the tree.
+/// @param node the root of the subtree, which must have a left child.
+static void __rb_rotate_right(sched_rb_root_t *tree, sched_rb_node_t *node)
+{
+    sched_rb_node_t *pivot = node->left;
+    node->left             = pivot->right;
+    if (pivot->right) {
+        pivot->right->parent = node;
+    }
+    pivot->parent = node->parent;
+    __rb_replace_child(tree, node->parent, node, pivot);
+    pivot->right = node;
+    node->parent = pivot;
+}
+
+/// @brief Checks if the node is black, leaves (NULL) are black.
+/// @param node the node.
+/// @return true if the node is black, false otherwise.
+static inline bool_t __rb_is_black(sched_rb_node_t *node)
+{
+    return (node == NULL) || (node->color == SCHED_RB_BLACK);
+}
+
+/// @brief Returns the node that follows the given one in the tree.
+/// @param node the node.
+/// @return the next node, or NULL if node is the last one.
+static inline sched_rb_node_t *__rb_next(sched_rb_node_t *node)
+{
+    // The next node is the leftmost one of the right subtree...
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return node;
+    }
+    // ...or the first ancestor of which we are in the left subtree.
+    while (node->parent && (node == node->parent->right)) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+/// @brief Restores the properties of the tree after the insertion of a red node.
+/// @param tree the tree.
+/// @param node the inserted node.
+static void __rb_insert_fixup(sched_rb_root_t *tree, sched_rb_node_t *node)
+{
+    // A red node cannot have a red parent.
+    while (node->parent && (node->parent->color == SCHED_RB_RED)) {
+        sched_rb_node_t *parent      = node->parent;
+        // The parent is red, so it is not the root.
+        sched_rb_node_t *grandparent = parent->parent;
+        if (parent == grandparent->left) {
+            sched_rb_node_t *uncle = grandparent->right;
+            if (!__rb_is_black(uncle)) {
+                // Push the blackness down from the grandparent, and go up.
+                parent->color      = SCHED_RB_BLACK;
+                uncle->color       = SCHED_RB_BLACK;
+                grandparent->color = SCHED_RB_RED;
+                node               = grandparent;
+                continue;
+            }
+            if (node == parent->right) {
+                __rb_rotate_left(tree, parent);
+                parent = node;
+            }
+            parent->color      = SCHED_RB_BLACK;
+            grandparent->color = SCHED_RB_RED;
+            __rb_rotate_right(tree, grandparent);
+            // The subtree has a black root now, we are done.
+            break;
+        } else {
+            sched_rb_node_t *uncle = grandparent->left;
+            if (!__rb_is_black(uncle)) {
+                // Push the blackness down from the grandparent, and go up.
+                parent->color      = SCHED_RB_BLACK;
+                uncle->color       = SCHED_RB_BLACK;
+                grandparent->color = SCHED_RB_RED;
+                node               = grandparent;
+                continue;
+            }
+            if (node == parent->left) {
+                __rb_rotate_right(tree, parent);
+                parent = node;
+            }
+            parent->color      = SCHED_RB_BLACK;
+            grandparent->color = SCHED_RB_RED;
+            __rb_rotate_left(tree, grandparent);
+            break;
+        }
+    }
+    tree->root->color = SCHED_RB_BLACK;
+}
+
+/// @brief Restores the properties of the tree after a black node has been
+/// removed, leaving the path through node one black node short.
+/// @param tree   the tree.
+/// @param node   the node that took the place of the removed one (can be NULL).
+/// @param parent the parent of node.
+static void __rb_erase_fixup(sched_rb_root_t *tree, sched_rb_node_t *node, sched_rb_node_t *parent)
+{
+    while ((node != tree->root) && __rb_is_black(node)) {
+        if (node == parent->left) {
+            sched_rb_node_t *sibling = parent->right;
+            if (!__rb_is_black(sibling)) {
+                sibling->color = SCHED_RB_BLACK;
+                parent->color  = SCHED_RB_RED;
+                __rb_rotate_left(tree, parent);
+                sibling = parent->right;
+            }
+            if (__rb_is_black(sibling->left) && __rb_is_black(sibling->right)) {
+                // Move the missing black node up.
+                sibling->color = SCHED_RB_RED;
+                node           = parent;
+                parent         = node->parent;
+                continue;
+            }
+            if (__rb_is_black(sibling->right)) {
+                sibling->left->color = SCHED_RB_BLACK;
+                sibling->color       = SCHED_RB_RED;
+                __rb_rotate_right(tree, sibling);
+                sibling = parent->right;
+            }
+            sibling->color        = parent->color;
+            parent->color         = SCHED_RB_BLACK;
+            sibling->right->color = SCHED_RB_BLACK;
+            __rb_rotate_left(tree, parent);
+        } else {
+            sched_rb_node_t *sibling = parent->left;
+            if (!__rb_is_black(sibling)) {
+                sibling->color = SCHED_RB_BLACK;
+                parent->color  = SCHED_RB_RED;
+                __rb_rotate_right(tree, parent);
+                sibling = parent->left;
+            }
+            if (__rb_is_black(sibling->left) && __rb_is_black(sibling->right)) {
+                // Move the missing black node up.
+                sibling->color = SCHED_RB_RED;
+                node           = parent;
+                parent         = node->parent;
+                continue;
+            }
+            if (__rb_is_black(sibling->left)) {
+                sibling->right->color = SCHED_RB_BLACK;
+                sibling->color        = SCHED_RB_RED;
+                __rb_rotate_left(tree, sibling);
+                sibling = parent->left;
+            }
+            sibling->color       = parent->color;
+            parent->color        = SCHED_RB_BLACK;
+            sibling->left->color = SCHED_RB_BLACK;
+            __rb_rotate_right(tree, parent);
+        }
+        node = tree->root;
+        break;
+    }
+    if (node) {
+        node->color = SCHED_RB_BLACK;
+    }
+}
+
+/// @brief Removes a node from the tree.
+/// @param tree the tree.
+/// @param node the node to remove.
+static void __rb_erase(sched_rb_root_t *tree, sched_rb_node_t *node)
+{
+    sched_rb_node_t *child, *parent;
+    int color;
+
+    // Keep track of the smallest node.
+    if (tree->leftmost == node) {
+        tree->leftmost = __rb_next(node);
+    }
+
+    if ((node->left == NULL) || (node->right == NULL)) {
+        // Replace the node with its only child (if any).
+        child  = node->left ? node->left : node->right;
+        parent = node->parent;
+        color  = node->color;
+        __rb_replace_child(tree, parent, node, child);
+        if (child) {
+            child->parent = parent;
+        }
+    } else {
+        // Replace the node with its successor, which has no left child.
+        sched_rb_node_t *successor = node->right;
+        while (successor->left) {
+            successor = successor->left;
+        }
+        child = successor->right;
+        color = successor->color;
+        if (successor->parent == node) {
+            parent = successor;
+        } else {
+            parent       = successor->parent;
+            parent->left = child;
+            if (child) {
+                child->parent = parent;
+            }
+            successor->right    = node->right;
+            node->right->parent = successor;
+        }
+        successor->left    = node->left;
+        node->left->parent = successor;
+        successor->color   = node->color;
+        successor->parent  = node->parent;
+        __rb_replace_child(tree, node->parent, node, successor);
+    }
+    if (color == SCHED_RB_BLACK) {
+        __rb_erase_fixup(tree, child, parent);
+    }
+    tree->size--;
+}
+
+/// @brief Adds a node to the tree, nodes with the same key are kept in
+/// insertion order.
+/// @param tree the tree.
+/// @param node the node to add, with its key already set.
+static void __rb_insert(sched_rb_root_t *tree, sched_rb_node_t *node)
+{
+    sched_rb_node_t **link = &tree->root, *parent = NULL;
+    // Tells if we always went left, i.e., the node becomes the smallest one.
+    bool_t leftmost = true;
+
+    // Look for the place of the node.
+    while (*link) {
+        parent = *link;
+        if (node->key < parent->key) {
+            link = &parent->left;
+        } else {
+            link     = &parent->right;
+            leftmost = false;
+        }
+    }
+    node->parent = parent;
+    node->left   = NULL;
+    node->right  = NULL;
+    node->color  = SCHED_RB_RED;
+    *link        = node;
+    if (leftmost) {
+        tree->leftmost = node;
+    }
+    __rb_insert_fixup(tree, node);
+    tree->size++;
+}
+
+void scheduler_cfs_enqueue(runqueue_t *runqueue, task_struct *task)
+{
+    if (task->se.on_tree) {
+        return;
+    }
+    task->se.run_node.key = task->se.vruntime;
+    __rb_insert(&runqueue->cfs_tree, &task->se.run_node);
+    task->se.on_tree = true;
+}
+
+void scheduler_cfs_dequeue(runqueue_t *runqueue, task_struct *task)
+{
+    if (!task->se.on_tree) {
+        return;
+    }
+    __rb_erase(&runqueue->cfs_tree, &task->se.run_node);
+    task->se.on_tree = false;
+}
+
+#if SCHED_HOT_SLOTS
+/// Value of se.hot_slot for a runnable task which has been left without a slot.
+#define HOT_SLOT_OVERFLOW (SCHED_HOT_SLOTS + 1U)
+
+/// @brief Returns the slot of the hot scheduling fields of the task.
+/// @param task the task.
+/// @return the slot, -1 if the task has none.
+static inline int __hot_slot(task_struct *task)
+{
+    if ((task->se.hot_slot == 0) || (task->se.hot_slot == HOT_SLOT_OVERFLOW))
+        return -1;
+    return (int)task->se.hot_slot - 1;
+}
+#endif
+
+/// @brief Gives a slot of the hot scheduling fields to a task which became
+/// runnable, after the ones of the other tasks (enqueue of the Round Robin and
+/// of the static priority).
+/// @param runqueue the runqueue.
+/// @param task     the task.
+static void __hot_enqueue(runqueue_t *runqueue, task_struct *task)
+{
+#if SCHED_HOT_SLOTS
+    sched_hot_t *hot = &runqueue->hot;
+    if (task->se.hot_slot)
+        return;
+    if (hot->size == SCHED_HOT_SLOTS) {
+        ++hot->overflow;
+        task->se.hot_slot = HOT_SLOT_OVERFLOW;
+        return;
+    }
+    hot->task[hot->size]     = task;
+    hot->prio[hot->size]     = scheduler_effective_prio(task);
+    hot->periodic[hot->size] = __is_periodic_task(task);
+    task->se.hot_slot        = ++hot->size;
+#endif
+}
+
+/// @brief Frees the slot of the hot scheduling fields of a task, which is
+/// taken by the task in the last slot (dequeue of the Round Robin and of the
+/// static priority).
+/// @param runqueue the runqueue.
+/// @param task     the task.
+static void __hot_dequeue(runqueue_t *runqueue, task_struct *task)
+{
+#if SCHED_HOT_SLOTS
+    sched_hot_t *hot = &runqueue->hot;
+    int slot         = __hot_slot(task);
+    if (slot < 0) {
+        if (task->se.hot_slot == HOT_SLOT_OVERFLOW)
+            --hot->overflow;
+        task->se.hot_slot = 0;
+        return;
+    }
+    size_t last = --hot->size;
+    if ((size_t)slot != last) {
+        hot->task[slot]              = hot->task[last];
+        hot->prio[slot]              = hot->prio[last];
+        hot->periodic[slot]          = hot->periodic[last];
+        hot->task[slot]->se.hot_slot = slot + 1;
+    }
+    task->se.hot_slot = 0;
+#endif
+}
+
+void scheduler_hot_update(runqueue_t *runqueue, task_struct *task)
+{
+#if SCHED_HOT_SLOTS
+    int slot = __hot_slot(task);
+    if (slot >= 0) {
+        runqueue->hot.prio[slot]     = scheduler_effective_prio(task);
+        runqueue->hot.periodic[slot] = __is_periodic_task(task);
+    }
+#endif
+}
+
+/// @brief Returns the task owning the given node of a real-time tree.
+#define RT_TASK(node) list_entry(node, task_struct, se.rt_node)
+
+/// @brief Adds the task to one of the real-time trees.
+/// @param tree the tree.
+/// @param task the task.
+/// @param key  the key the task is sorted by.
+static inline void __rt_insert(sched_rb_root_t *tree, task_struct *task, vruntime_t key)
+{
+    task->se.rt_node.key = key;
+    task->se.rt_tree     = tree;
+    __rb_insert(tree, &task->se.rt_node);
+}
+
+/// @brief Adds a task which inherits a real-time key to the ready tasks, with
+/// its own key if it comes first, so that it runs before the tasks its
+/// waiters would run before.
+/// @param runqueue the runqueue.
+/// @param task     the task.
+/// @param key      the key of the task, 0 if it would not be ready.
+/// @return true if the task has been added, false if it inherits no key.
+static inline bool_t __rt_enqueue_inherited(runqueue_t *runqueue, task_struct *task, vruntime_t key)
+{
+    if (!task->se.pi_key) {
+        return false;
+    }
+    __rt_insert(&runqueue->rt->rt_ready, task, (key && (key < task->se.pi_key)) ? key : task->se.pi_key);
+    return true;
+}
+
+/// @brief Adds a periodic task to the real-time trees: to the release queue
+/// if it has already been executed in its current period, to the ready
+/// tasks otherwise.
+/// @param runqueue the runqueue.
+/// @param task     the task.
+/// @param key      the key of the task among the ready tasks.
+static inline void __rt_enqueue_periodic(runqueue_t *runqueue, task_struct *task, vruntime_t key)
+{
+    if (task->se.rt_tree) {
+        return;
+    }
+    // Even if it is not periodic, or its job is over, a task holding what a
+    // real-time task waits for is ready.
+    if (__rt_enqueue_inherited(runqueue, task, (__is_periodic_task(task) && !task->se.executed) ? key : 0)) {
+        return;
+    }
+    if (!__is_periodic_task(task)) {
+        return;
+    }
+    // A task executed in its current period waits for the next one.
+    if (task->se.executed) {
+        __rt_insert(&runqueue->rt->rt_release, task, task->se.next_period);
+    } else {
+        __rt_insert(&runqueue->rt->rt_ready, task, key);
+    }
+}
+
+/// @brief Adds a periodic task to the trees of the EDF.
+/// @param runqueue the runqueue.
+/// @param task     the task.
+static void __rt_enqueue_edf(runqueue_t *runqueue, task_struct *task)
+{
+    __rt_enqueue_periodic(runqueue, task, task->se.deadline);
+}
+
+/// @brief Adds a periodic task to the trees of the RM.
+/// @details The priorities are fixed by the period, as the response time
+/// analysis of the admission test assumes, the earliest next period breaks
+/// the ties.
+/// @param runqueue the runqueue.
+/// @param task     the task.
+static void __rt_enqueue_rm(runqueue_t *runqueue, task_struct *task)
+{
+    __rt_enqueue_periodic(runqueue, task, ((vruntime_t)task->se.period << 32) | task->se.next_period);
+}
+
+/// @brief Returns the key of a task for the LLF.
+/// @details The laxity of a task is (deadline - now - remaining work), the
+/// remaining work of the current job being (worst_case_exec - job_exec_runtime).
+/// The laxity of all the waiting tasks drops at the same rate, while the one
+/// of the running task stays the same, since the work it has done grows with
+/// the time. Hence, sorting by (laxity + now) keeps the order of the waiting
+/// tasks fixed, and only the key of the running task must be updated: it grows
+/// by the ticks the task runs, until another task is ahead by LLF_QUANTUM. The
+/// key is offset by 2^32 so that it stays positive.
+/// @param task the task.
+/// @return the key of the task.
+static inline vruntime_t __llf_key(task_struct *task)
+{
+    return (1ULL << 32) + task->se.deadline - task->se.worst_case_exec + task->se.job_exec_runtime;
+}
+
+/// @brief Adds a periodic task to the trees of the LLF.
+/// @param runqueue the runqueue.
+/// @param task     the task.
+static void __rt_enqueue_llf(runqueue_t *runqueue, task_struct *task)
+{
+    __rt_enqueue_periodic(runqueue, task, __llf_key(task));
+}
+
+/// @brief Adds a task with a deadline to the ready tasks of the AEDF.
+/// @param runqueue the runqueue.
+/// @param task     the task.
+static void __rt_enqueue_aedf(runqueue_t *runqueue, task_struct *task)
+{
+    if (task->se.rt_tree || __rt_enqueue_inherited(runqueue, task, task->se.deadline) || (task->se.deadline == 0)) {
+        return;
+    }
+    __rt_insert(&runqueue->rt->rt_ready, task, task->se.deadline);
+}
+
+/// @brief Removes a task from the real-time trees.
+/// @param runqueue the runqueue.
+/// @param task     the task.
+static void __rt_dequeue(runqueue_t *runqueue, task_struct *task)
+{
+    if (!task->se.rt_tree) {
+        return;
+    }
+    __rb_erase(task->se.rt_tree, &task->se.rt_node);
+    task->se.rt_tree = NULL;
+}
+
+/// @brief Returns the first ready real-time task the CPU can run, skipping the
+/// ones running on other CPUs (which share the trees under the global
+/// scheduling).
+/// @param runqueue the runqueue of the CPU.
+/// @return the task, NULL if there is none.
+static inline task_struct *__rt_first(runqueue_t *runqueue)
+{
+    for (sched_rb_node_t *node = runqueue->rt->rt_ready.leftmost; node; node = __rb_next(node)) {
+        task_struct *task = RT_TASK(node);
+        if ((task->se.cpu == runqueue->cpu) || !scheduler_is_running(task))
+            return task;
+    }
+    return NULL;
+}
+
+void scheduler_class_enqueue(runqueue_t *runqueue, task_struct *task)
+{
+    if (runqueue->policy->enqueue_task) {
+        runqueue->policy->enqueue_task(runqueue, task);
+    }
+}
+
+void scheduler_class_dequeue(runqueue_t *runqueue, task_struct *task)
+{
+    if (runqueue->policy->dequeue_task) {
+        runqueue->policy->dequeue_task(runqueue, task);
+    }
+}
+
+/// @brief Releases the periodic tasks whose next period has started: they
+/// can be executed again, and their deadline and next period move forward.
+/// @param runqueue the runqueue.
+static inline void __release_periodic_tasks(runqueue_t *runqueue)
+{
+    time_t now = timer_get_ticks();
+    // The release queue is sorted by next period, stop at the first task
+    // which is still waiting.
+    while (runqueue->rt->rt_release.leftmost) {
+        task_struct *entry = RT_TASK(runqueue->rt->rt_release.leftmost);
+        if (entry->se.next_period > now)
+            break;
+        __rt_dequeue(runqueue, entry);
+        entry->se.executed         = false;
+        entry->se.job_exec_runtime = 0;
+        entry->se.deadline += entry->se.period;
+        entry->se.next_period += entry->se.period;
+        scheduler_class_enqueue(runqueue, entry);
+        scheduler_trace(SCHED_TRACE_RELEASE, entry->pid, 0, entry->se.deadline);
+    }
+}
+
 /// @brief Employs time-sharing, giving each job a timeslice, and is also
 /// preemptive since the scheduler forces the task out of the CPU once
 /// the timeslice expires.
@@ -42,27 +645,42 @@ static inline bool_t __is_periodic_task(task_struct *task)
 /// @return the next task on success, NULL on failure.
 static inline task_struct *__scheduler_rr(runqueue_t *runqueue, bool_t skip_periodic)
 {
-    // If there is just one task, return it; no need to do anything.
-    if (list_head_size(&runqueue->curr->run_list) <= 1) {
-        return runqueue->curr;
+#if SCHED_HOT_SLOTS
+    sched_hot_t *hot = &runqueue->hot;
+    if (!hot->overflow) {
+        // Scan the slots after the one of the current task, wrapping around.
+        int current = __hot_slot(runqueue->curr);
+        size_t slot = current + 1, count = (current < 0) ? hot->size : hot->size - 1;
+        for (; count; --count, ++slot) {
+            if (slot == hot->size)
+                slot = 0;
+            if (!(hot->periodic[slot] && skip_periodic))
+                return hot->task[slot];
+        }
+        // Keep running the current task, if it is the only runnable one.
+        if ((current >= 0) && !(hot->periodic[current] && skip_periodic))
+            return runqueue->curr;
+        return NULL;
     }
-    // Search for the next task (we do not start from the head, so INSIDE, skip the head).
-    list_for_each_decl(it, &runqueue->curr->run_list)
+#endif
+    list_head *start = __runnable_start(runqueue);
+    // Search for the next task (we might not start from the head, so INSIDE, skip the head).
+    list_for_each_decl(it, start)
     {
         // Check if we reached the head of list_head, and skip it.
-        if (it == &runqueue->queue)
+        if (it == &runqueue->runnable)
             continue;
         // Get the current entry.
-        task_struct *entry = list_entry(it, task_struct, run_list);
-        // We consider only runnable processes
-        if (entry->state != TASK_RUNNING)
-            continue;
+        task_struct *entry = list_entry(it, task_struct, runnable_list);
         // If entry is a periodic task, and we were asked to skip periodic tasks, skip it.
         if (__is_periodic_task(entry) && skip_periodic)
             continue;
         // We have our next entry.
         return entry;
     }
+    // Keep running the current task, if it is the only runnable one.
+    if ((start != &runqueue->runnable) && !(__is_periodic_task(runqueue->curr) && skip_periodic))
+        return runqueue->curr;
     return NULL;
 }
 
@@ -77,42 +695,53 @@ static inline task_struct *__scheduler_rr(runqueue_t *runqueue, bool_t skip_peri
 /// @return the next task on success, NULL on failure.
 static inline task_struct *__scheduler_priority(runqueue_t *runqueue, bool_t skip_periodic)
 {
-#ifdef SCHEDULER_PRIORITY
-    // Get the first element of the list.
-    task_struct *next = list_entry(runqueue->queue.next, struct task_struct, run_list);
-
-    // Get its static priority.
-    time_t min = next->se.prio;
+    task_struct *next = NULL;
 
-    // If there is just one task, return it; no need to do anything.
-    if (list_head_size(&runqueue->curr->run_list) <= 1) {
-        return runqueue->curr;
+#if SCHED_HOT_SLOTS
+    sched_hot_t *hot = &runqueue->hot;
+    if (!hot->overflow) {
+        // The same search, on the packed priorities.
+        int current = __hot_slot(runqueue->curr), best = -1;
+        size_t slot = current + 1, count = (current < 0) ? hot->size : hot->size - 1;
+        for (; count; --count, ++slot) {
+            if (slot == hot->size)
+                slot = 0;
+            if (hot->periodic[slot] && skip_periodic)
+                continue;
+            if ((best < 0) || (hot->prio[slot] < hot->prio[best]))
+                best = (int)slot;
+        }
+        if ((current >= 0) && !(hot->periodic[current] && skip_periodic))
+            if ((best < 0) || (hot->prio[current] < hot->prio[best]))
+                best = current;
+        return (best < 0) ? NULL : hot->task[best];
     }
-
-    // Search for the task with the smallest static priority.
-    list_for_each_decl(it, &runqueue->curr->run_list)
+#endif
+    // Search for the task with the smallest static priority, starting after
+    // the current one, so that tasks with the same priority take turns.
+    list_head *start = __runnable_start(runqueue);
+    list_for_each_decl(it, start)
     {
         // Check if we reached the head of list_head, and skip it.
-        if (it == &runqueue->queue)
+        if (it == &runqueue->runnable)
             continue;
         // Get the current entry.
-        task_struct *entry = list_entry(it, task_struct, run_list);
-        // We consider only runnable processes
-        if (entry->state != TASK_RUNNING)
-            continue;
+        task_struct *entry = list_entry(it, task_struct, runnable_list);
         // If entry is a periodic task, and we were asked to skip periodic tasks, skip it.
         if (__is_periodic_task(entry) && skip_periodic)
             continue;
         // Check if the entry has a lower priority.
-        if (entry->se.prio <= min) {
-                next = entry;
-                min = entry->se.prio;
+        if ((next == NULL) || (scheduler_effective_prio(entry) < scheduler_effective_prio(next))) {
+            next = entry;
+        }
+    }
+    // The current task keeps the CPU only if it has a strictly lower priority.
+    if ((start != &runqueue->runnable) && !(__is_periodic_task(runqueue->curr) && skip_periodic)) {
+        if ((next == NULL) || (scheduler_effective_prio(runqueue->curr) < scheduler_effective_prio(next))) {
+            next = runqueue->curr;
         }
     }
     return next;
-#else
-    return __scheduler_rr(runqueue, skip_periodic);
-#endif
 }
 
 
@@ -127,41 +756,19 @@ static inline task_struct *__scheduler_priority(runqueue_t *runqueue, bool_t ski
 /// @return the next task on success, NULL on failure.
 static inline task_struct *__scheduler_cfs(runqueue_t *runqueue, bool_t skip_periodic)
 {
-
-    // Get the first element of the list.
-    task_struct *next = list_entry(runqueue->queue.next, struct task_struct, run_list);
-
-
-    // Get its virtual runtime.
-    time_t min = next->se.vruntime;
-
-    // If there is just one task, return it; no need to do anything.
-    if (list_head_size(&runqueue->curr->run_list) <= 1) {
-        return runqueue->curr;
-    }
-
-    // Search for the task with the smallest vruntime value.
-    list_for_each_decl(it, &runqueue->curr->run_list)
-    {
-        // Check if we reached the head of list_head, and skip it.
-        if (it == &runqueue->queue)
-            continue;
+    // The runnable tasks are sorted by vruntime, start from the smallest one.
+    sched_rb_node_t *node = runqueue->cfs_tree.leftmost;
+    while (node) {
         // Get the current entry.
-        task_struct *entry = list_entry(it, task_struct, run_list);
-        // We consider only runnable processes
-        if (entry->state != TASK_RUNNING)
-            continue;
+        task_struct *entry = CFS_TASK(node);
+        node               = __rb_next(node);
         // If entry is a periodic task, and we were asked to skip periodic tasks, skip it.
         if (__is_periodic_task(entry) && skip_periodic)
             continue;
-
-        // Check if the element in the list has a smaller vruntime value.
-        if (entry->se.vruntime < min) {
-            next = entry;
-            min = entry->se.vruntime;
-        }
+        // We have the task with the smallest vruntime value.
+        return entry;
     }
-    return next;
+    return NULL;
 }
 
 /// @brief Executes the task with the earliest absolute deadline among all the
@@ -170,35 +777,69 @@ static inline task_struct *__scheduler_cfs(runqueue_t *runqueue, bool_t skip_per
 /// @return the next task on success, NULL on failure.
 static inline task_struct *__scheduler_aedf(runqueue_t *runqueue)
 {
-    //pointer to the next task
-    task_struct *next = NULL, *entry;
-
-    //the next deadline, starting from the maximum possible one
-    time_t next_dl = UINT_MAX;
-
-    list_for_each_decl(it, &runqueue->queue){
-
-        //if we're at the head, we skip it
-        if(it == &runqueue->queue)
-            continue;
+    //the ready tasks are sorted by deadline, the first one is the next task,
+    //then if i haven't found a valid "real time" task, the CFS is used
+    return __rt_first(runqueue);
+}
 
-        entry = list_entry(it, task_struct, run_list);
+/// @brief Checks if the Constant Bandwidth Server is enabled.
+/// @param runqueue the runqueue.
+/// @return true if the server is enabled, false otherwise.
+static inline bool_t __cbs_enabled(runqueue_t *runqueue)
+{
+    return (runqueue->cbs.se.period > 0) && (runqueue->cbs.se.worst_case_exec > 0);
+}
 
-        //check that it's not an entry with deadline 0
-        if(entry->se.deadline != 0){
-            if(entry->se.deadline <= next_dl){
-                next = entry;
-                next_dl = next->se.deadline;
-            }
+/// @brief Picks the aperiodic task to run with the Constant Bandwidth Server,
+/// if the deadline of the server comes before the one of the periodic task.
+/// @param runqueue the runqueue.
+/// @param periodic the periodic task EDF would run, NULL if none.
+/// @return the aperiodic task, NULL if the periodic task should run.
+static inline task_struct *__cbs_pick(runqueue_t *runqueue, task_struct *periodic)
+{
+    sched_cbs_t *cbs = &runqueue->cbs;
+    cbs->running     = false;
+    if (!__cbs_enabled(runqueue))
+        return NULL;
+    task_struct *aperiodic = __scheduler_cfs(runqueue, true);
+    if (aperiodic == NULL) {
+        // The server becomes idle.
+        cbs->active = false;
+        return NULL;
+    }
+    if (!cbs->active) {
+        // When it is woken up, the server keeps its deadline only if the
+        // remaining budget is below its bandwidth until that deadline,
+        // otherwise (budget >= (deadline - now) * Q / T) a new server
+        // period starts with a full budget.
+        int now = timer_get_ticks();
+        if (((long long)cbs->budget * cbs->se.period) >= ((long long)((int)cbs->se.deadline - now) * cbs->se.worst_case_exec)) {
+            cbs->se.deadline = now + cbs->se.period;
+            cbs->budget      = cbs->se.worst_case_exec;
         }
+        cbs->active = true;
     }
+    if ((periodic != NULL) && (periodic->se.deadline <= cbs->se.deadline))
+        return NULL;
+    cbs->running = true;
+    return aperiodic;
+}
 
-    //then if i haven't found a valid "real time" task, i use the CFS
-    if(next == NULL)
-        next = __scheduler_cfs(runqueue, true); //true = skips periodic tasks
-
-    return next;
-    
+/// @brief Charges the execution time of the running task to the Constant
+/// Bandwidth Server, if the server picked it. When the budget is exhausted, it
+/// is recharged and the deadline of the server is postponed by one period.
+/// @param runqueue the runqueue.
+/// @param delta    the execution time.
+static inline void __cbs_charge(runqueue_t *runqueue, time_t delta)
+{
+    sched_cbs_t *cbs = &runqueue->cbs;
+    if (!cbs->running)
+        return;
+    cbs->budget -= (int)delta;
+    while (cbs->budget <= 0) {
+        cbs->budget += cbs->se.worst_case_exec;
+        cbs->se.deadline += cbs->se.period;
+    }
 }
 
 /// @brief Executes the task with the earliest absolute DEADLINE among all the
@@ -209,52 +850,34 @@ static inline task_struct *__scheduler_aedf(runqueue_t *runqueue)
 /// @return the next task on success, NULL on failure.
 static inline task_struct *__scheduler_edf(runqueue_t *runqueue)
 {
-    //pointer to the next task
-    task_struct *next = NULL, *entry;
+    //the tasks whose period is starting again become executable again
+    __release_periodic_tasks(runqueue);
 
-    //the next deadline, starting from the maximum possible one
-    time_t next_dl = UINT_MAX;
+    //the ready tasks are sorted by deadline, the first one is the next task
+    task_struct *next = __rt_first(runqueue);
 
-    //iterate over the tasks list looking for the mimimum deadline
-    list_for_each_decl(it, &runqueue->queue){
-
-        //if we're at the head, we skip it
-        if(it == &runqueue->queue)
-            continue;
-        
-        //gets the task_struct from the list node
-        entry = list_entry(it, task_struct, run_list);
-
-        //we skip non-period tasks or a periodic task that's still undergoing schedulability analysis
-        if(!entry->se.is_periodic || entry->se.is_under_analysis)
-            continue;
-        
-        /*
-        if the entry has already been executed and the time period is starting again
-        I mark it as executable again and update the periods
-        */
-        if(entry->se.executed && (entry->se.next_period <= timer_get_ticks())){
-
-            entry->se.executed = false;
-            entry->se.deadline += entry->se.period;
-            entry->se.next_period += entry->se.period;
-
-        }//if it's not marked as executed I check if it's the closest deadline
-        else if(!entry->se.executed && (entry->se.deadline < next_dl)){
-            next = entry;
-            next_dl = next->se.deadline;
-        }
-
-    }
-
-    //then if i haven't found a valid periodic task, i use the CFS
-    if(next == NULL)
-        next = __scheduler_cfs(runqueue, true); //true = skips periodic tasks
+    //the aperiodic tasks run when the deadline of their server comes first
+    task_struct *aperiodic = __cbs_pick(runqueue, next);
+    if(aperiodic)
+        return aperiodic;
 
+    //then if i haven't found a valid periodic task, the CFS is used
     return next;
 }
 
-/// @brief Executes the task with the earliest next PERIOD among all the ready
+/// @brief Accounts the execution of the running task for the EDF, charging
+/// it to the aperiodic server if the server picked it.
+/// @param runqueue the runqueue.
+/// @param task     the running task.
+static void __edf_task_tick(runqueue_t *runqueue, task_struct *task)
+{
+    // Get the time actually spent, before it is weighted for the CFS.
+    time_t delta = timer_get_ticks() - task->se.exec_start;
+    __update_task_statistics(runqueue, task);
+    __cbs_charge(runqueue, delta);
+}
+
+/// @brief Executes the task with the shortest PERIOD among all the ready
 /// tasks.
 /// @details When a task was executed, and its period is starting again, it must
 /// be set as 'executable again', and its deadline and next_period must be
@@ -263,44 +886,12 @@ static inline task_struct *__scheduler_edf(runqueue_t *runqueue)
 /// @return the next task on success, NULL on failure.
 static inline task_struct *__scheduler_rm(runqueue_t *runqueue)
 {
-    //pointer to the next task
-    task_struct *next = NULL, *entry;
-
-    //the next period, starting from the maximum possible one
-    time_t next_np = UINT_MAX;
-
-    //iterate over the tasks list looking for the closest next period
-    list_for_each_decl(it, &runqueue->queue){
-
-        //if we're at the head, we skip it
-        if(it == &runqueue->queue)
-            continue;
-        
-        //gets the task_struct from the list node
-        entry = list_entry(it, task_struct, run_list);
-
-        //we skip non-period tasks or a periodic task that's still undergoing schedulability analysis
-        if(!entry->se.is_periodic || entry->se.is_under_analysis)
-            continue;
-
-        if(entry->se.executed && (entry->se.next_period <= timer_get_ticks())){
+    //the tasks whose period is starting again become executable again
+    __release_periodic_tasks(runqueue);
 
-            entry->se.executed = false;
-            entry->se.deadline += entry->se.period;
-            entry->se.next_period += entry->se.period;
-
-        }//if it's not marked as executed I check if it's the closest deadline
-        else if(!entry->se.executed && (entry->se.next_period < next_np)){
-            next = entry;
-            next_np = next->se.next_period;
-        }
-    }
-
-    //then if i haven't found a valid periodic task, i use the CFS
-    if(next == NULL)
-        next = __scheduler_cfs(runqueue, true); //true = skips periodic tasks
-
-    return next;
+    //the ready tasks are sorted by period, the first one is the next task,
+    //then if i haven't found a valid periodic task, the CFS is used
+    return __rt_first(runqueue);
 }
 
 /// @brief Executes the task with the least laxity among all the ready
@@ -313,88 +904,223 @@ static inline task_struct *__scheduler_rm(runqueue_t *runqueue)
 /// @return the next task on success, NULL on failure.
 static inline task_struct *__scheduler_llf(runqueue_t *runqueue)
 {
-    //pointer to the next task
-    task_struct *next = NULL, *entry;
-
-    //the next period, starting from the maximum possible one
-    time_t min_lax = UINT_MAX;
+    //the tasks whose period is starting again become executable again
+    __release_periodic_tasks(runqueue);
 
-    //iterate over the tasks list looking for the closest next period
-    list_for_each_decl(it, &runqueue->queue){
-
-        //if we're at the head, we skip it
-        if(it == &runqueue->queue)
-            continue;
-        
-        //gets the task_struct from the list node
-        entry = list_entry(it, task_struct, run_list);
-
-        //we skip non-period tasks or a periodic task that's still undergoing schedulability analysis
-        if(!entry->se.is_periodic || entry->se.is_under_analysis)
-            continue;
+    //the ready tasks are sorted by laxity, the first one is the least laxed
+    task_struct *next = __rt_first(runqueue);
+    if(next == NULL)
+        return NULL; //then if i haven't found a valid real time task, the CFS is used
 
-        if(entry->se.executed && (entry->se.next_period <= timer_get_ticks())){
+    //plain LLF switches at every tick between tasks with the same laxity,
+    //the running task keeps the CPU until another task has a laxity lower
+    //than its own by more than LLF_QUANTUM ticks
+    task_struct *curr = runqueue->curr;
+    if((next != curr) && (curr->se.rt_tree == &runqueue->rt->rt_ready))
+        if(curr->se.rt_node.key <= next->se.rt_node.key + LLF_QUANTUM)
+            return curr;
 
-            entry->se.executed = false;
-            entry->se.deadline += entry->se.period;
-            entry->se.next_period += entry->se.period;
+    return next;
+}
 
-        }//if it's not marked as executed I check if it's the least laxed
-        else if(!entry->se.executed){
-            //get's how much time till the deadline
-            //laxity = remaining time - total execution time up to now
-            int this_lax = (entry->se.deadline - timer_get_ticks()) - entry->se.sum_exec_runtime;
-            if(this_lax < min_lax){
-                next = entry;
-                min_lax = this_lax;
-            }
-        }
+/// @brief Accounts the execution of the running task for the LLF, moving it
+/// to its new place among the ready tasks.
+/// @param runqueue the runqueue.
+/// @param task     the running task.
+static void __llf_task_tick(runqueue_t *runqueue, task_struct *task)
+{
+    __update_task_statistics(runqueue, task);
+    // The running task is the only one whose key changes, see __llf_key.
+    if (task->se.rt_tree == &runqueue->rt->rt_ready) {
+        __rt_dequeue(runqueue, task);
+        __rt_enqueue_llf(runqueue, task);
     }
+}
 
-    //then if i haven't found a valid real time task, i use the CFS
-    if(next == NULL)
-        next = __scheduler_cfs(runqueue, true); //true = skips periodic tasks
+/// @brief Picks the next task with the Round Robin.
+/// @param runqueue the runqueue.
+/// @return the next task, NULL if there is none.
+static task_struct *__pick_rr(runqueue_t *runqueue)
+{
+    return __scheduler_rr(runqueue, false);
+}
 
-    return next;
+/// @brief Picks the next task with the static priority.
+/// @param runqueue the runqueue.
+/// @return the next task, NULL if there is none.
+static task_struct *__pick_priority(runqueue_t *runqueue)
+{
+    return __scheduler_priority(runqueue, false);
 }
 
+/// @brief Picks the next task with the CFS.
+/// @param runqueue the runqueue.
+/// @return the next task, NULL if there is none.
+static task_struct *__pick_cfs(runqueue_t *runqueue)
+{
+    return __scheduler_cfs(runqueue, false);
+}
 
-task_struct *scheduler_pick_next_task(runqueue_t *runqueue)
+/// @brief Picks the next task with the CFS, skipping the periodic tasks,
+/// which belong to the real-time class tried before it.
+/// @param runqueue the runqueue.
+/// @return the next task, NULL if there is none.
+static task_struct *__pick_cfs_aperiodic(runqueue_t *runqueue)
 {
-    // Update task statistics.
-#if (defined(SCHEDULER_CFS) || defined(SCHEDULER_EDF) || defined(SCHEDULER_RM) || defined(SCHEDULER_AEDF) || defined(SCHEDULER_LLF))
-    __update_task_statistics(runqueue->curr);
-#endif
+    return __scheduler_cfs(runqueue, true);
+}
 
-    // Pointer to the next task to schedule.
-    task_struct *next = NULL;
+/// @brief The scheduling class of the Round Robin.
+static const sched_class_t rr_sched_class = {
+    .name           = "rr",
+    .policy         = SCHED_POLICY_RR,
+    .pick_next_task = __pick_rr,
+    .enqueue_task   = __hot_enqueue,
+    .dequeue_task   = __hot_dequeue,
+};
+
+/// @brief The scheduling class of the static priority.
+static const sched_class_t priority_sched_class = {
+    .name           = "priority",
+    .policy         = SCHED_POLICY_PRIORITY,
+    .pick_next_task = __pick_priority,
+    .enqueue_task   = __hot_enqueue,
+    .dequeue_task   = __hot_dequeue,
+};
+
+/// @brief The scheduling class of the CFS.
+static const sched_class_t cfs_sched_class = {
+    .name           = "cfs",
+    .policy         = SCHED_POLICY_CFS,
+    .pick_next_task = __pick_cfs,
+    .task_tick      = __update_task_statistics,
+};
+
+/// @brief The CFS running the aperiodic tasks below the real-time classes.
+static const sched_class_t cfs_aperiodic_sched_class = {
+    .name           = "cfs",
+    .policy         = SCHED_POLICY_CFS,
+    .pick_next_task = __pick_cfs_aperiodic,
+};
+
+/// @brief The scheduling class of the EDF.
+static const sched_class_t edf_sched_class = {
+    .name                    = "edf",
+    .policy                  = SCHED_POLICY_EDF,
+    .periodic_non_preemptive = true,
+    .pick_next_task          = __scheduler_edf,
+    .enqueue_task            = __rt_enqueue_edf,
+    .dequeue_task            = __rt_dequeue,
+    .task_tick               = __edf_task_tick,
+    .next                    = &cfs_aperiodic_sched_class,
+};
+
+/// @brief The scheduling class of the RM.
+static const sched_class_t rm_sched_class = {
+    .name           = "rm",
+    .policy         = SCHED_POLICY_RM,
+    .pick_next_task = __scheduler_rm,
+    .enqueue_task   = __rt_enqueue_rm,
+    .dequeue_task   = __rt_dequeue,
+    .task_tick      = __update_task_statistics,
+    .next           = &cfs_aperiodic_sched_class,
+};
+
+/// @brief The scheduling class of the AEDF.
+static const sched_class_t aedf_sched_class = {
+    .name           = "aedf",
+    .policy         = SCHED_POLICY_AEDF,
+    .pick_next_task = __scheduler_aedf,
+    .enqueue_task   = __rt_enqueue_aedf,
+    .dequeue_task   = __rt_dequeue,
+    .task_tick      = __update_task_statistics,
+    .next           = &cfs_aperiodic_sched_class,
+};
+
+/// @brief The scheduling class of the LLF.
+static const sched_class_t llf_sched_class = {
+    .name           = "llf",
+    .policy         = SCHED_POLICY_LLF,
+    .pick_next_task = __scheduler_llf,
+    .enqueue_task   = __rt_enqueue_llf,
+    .dequeue_task   = __rt_dequeue,
+    .task_tick      = __llf_task_tick,
+    .next           = &cfs_aperiodic_sched_class,
+};
+
+/// @brief The scheduling classes, indexed by policy.
+static const sched_class_t *sched_classes[SCHED_POLICY_COUNT] = {
+    [SCHED_POLICY_RR]       = &rr_sched_class,
+    [SCHED_POLICY_PRIORITY] = &priority_sched_class,
+    [SCHED_POLICY_CFS]      = &cfs_sched_class,
+    [SCHED_POLICY_EDF]      = &edf_sched_class,
+    [SCHED_POLICY_RM]       = &rm_sched_class,
+    [SCHED_POLICY_AEDF]     = &aedf_sched_class,
+    [SCHED_POLICY_LLF]      = &llf_sched_class,
+};
+
+const sched_class_t *scheduler_get_class(sched_policy_t policy)
+{
+    if ((policy < 0) || (policy >= SCHED_POLICY_COUNT)) {
+        return NULL;
+    }
+    return sched_classes[policy];
+}
+
+const sched_class_t *scheduler_get_default_class()
+{
 #if defined(SCHEDULER_RR)
-    next = __scheduler_rr(runqueue, false);
+    return &rr_sched_class;
 #elif defined(SCHEDULER_PRIORITY)
-    next = __scheduler_priority(runqueue, false);
+    return &priority_sched_class;
 #elif defined(SCHEDULER_CFS)
-    next = __scheduler_cfs(runqueue, false);
+    return &cfs_sched_class;
 #elif defined(SCHEDULER_EDF)
-    next = __scheduler_edf(runqueue);
+    return &edf_sched_class;
 #elif defined(SCHEDULER_RM)
-    next = __scheduler_rm(runqueue);
+    return &rm_sched_class;
 #elif defined(SCHEDULER_AEDF)
-    next = __scheduler_aedf(runqueue);
+    return &aedf_sched_class;
 #elif defined(SCHEDULER_LLF)
-    next = __scheduler_llf(runqueue);
+    return &llf_sched_class;
 #else
 #error "You should enable a scheduling algorithm!"
 #endif
+}
+
+task_struct *scheduler_pick_next_task(runqueue_t *runqueue)
+{
+    // Update task statistics, the cost of the tick handler is measured for the trace.
+    if (runqueue->policy->task_tick) {
+        unsigned long long tick_start = __sched_rdtsc();
+        runqueue->policy->task_tick(runqueue, runqueue->curr);
+        scheduler_trace(SCHED_TRACE_TICK, runqueue->curr->pid, 0, (unsigned int)(__sched_rdtsc() - tick_start));
+    }
+
+    // Pointer to the next task to schedule.
+    task_struct *next = NULL;
+    // Try the classes in order, e.g., the real-time ones before the CFS.
+    for (const sched_class_t *sched_class = runqueue->policy; sched_class && !next; sched_class = sched_class->next) {
+        next = sched_class->pick_next_task(runqueue);
+    }
+    // There are no runnable tasks, keep running the first one of the queue.
+    if (next == NULL) {
+        next = __no_runnable_task(runqueue);
+    }
 
     assert(next && "No valid task selected by the scheduling algorithm.");
 
+    // Under the global scheduling, a real-time task can come from the
+    // runqueue of another CPU.
+    scheduler_migrate_task(next, runqueue);
+
     // Update the last context switch time of the next task.
     next->se.exec_start = timer_get_ticks();
 
     return next;
 }
 
-static void __update_task_statistics(task_struct *task)
+static void __update_task_statistics(runqueue_t *runqueue, task_struct *task)
 {
     // See `prio.h` for more support functions.
     assert(task && "Current task is not valid.");
@@ -411,19 +1137,31 @@ static void __update_task_statistics(task_struct *task)
 
     // Set the sum_exec_runtime.
     task->se.sum_exec_runtime += task->se.exec_runtime;
+    task->se.job_exec_runtime += task->se.exec_runtime;
 
     // If the task is not a periodic task we have to update the virtual runtime.
     if (!task->se.is_periodic) {
-        // Get the weight of the current task.
-        time_t weight = GET_WEIGHT(task->se.prio);
         // If the weight is different from the default load, compute it.
-        if (weight != NICE_0_LOAD) {
-            // Get the multiplicative factor for its delta_exec.
-            double factor = ((double)NICE_0_LOAD)/((double)weight);
-            // Weight the delta_exec with the multiplicative factor.
-            task->se.exec_runtime = (int)(((double)task->se.exec_runtime)*factor);
+        if (GET_WEIGHT(task->se.prio) != NICE_0_LOAD) {
+#if SCHED_WEIGHT_WITH_FPU
+            double factor         = ((double)NICE_0_LOAD) / ((double)GET_WEIGHT(task->se.prio));
+            task->se.exec_runtime = (time_t)(((double)task->se.exec_runtime) * factor);
+#else
+            // Weight the delta_exec by (NICE_0_LOAD / weight), using the
+            // inverse of the weight to stay away from the FPU: this runs
+            // inside the timer interrupt.
+            unsigned long long factor = (unsigned long long)NICE_0_LOAD * GET_WMULT(task->se.prio);
+            task->se.exec_runtime     = (time_t)((task->se.exec_runtime * factor) >> WMULT_SHIFT);
+#endif
+        }
+        // Update vruntime of the current task, and move it to its new place
+        // in the tree of runnable tasks.
+        if (task->se.on_tree) {
+            scheduler_cfs_dequeue(runqueue, task);
+            task->se.vruntime += task->se.exec_runtime;
+            scheduler_cfs_enqueue(runqueue, task);
+        } else {
+            task->se.vruntime += task->se.exec_runtime;
         }
-        // Update vruntime of the current task.
-        task->se.vruntime += task->se.exec_runtime;
     }
 }
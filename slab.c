@@ -0,0 +1,523 @@
+/// @file mouse.h
+/// @brief  Driver for *PS2* Mouses.
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Include the kernel log levels.
+#include "sys/kernel_levels.h"
+/// Change the header.
+#define __DEBUG_HEADER__ "[SLAB  ]"
+/// Set the log level.
+#define __DEBUG_LEVEL__ LOGLEVEL_NOTICE
+
+#include "mem/zone_allocator.h"
+#include "mem/paging.h"
+#include "assert.h"
+#include "io/debug.h"
+#include "mem/slab.h"
+#include "stdio.h"
+#include "string.h"
+
+/// @brief Use it to manage cached pages.
+typedef struct kmem_obj {
+    /// The list_head for this object.
+    list_head objlist;
+} kmem_obj;
+
+/// Max order of kmalloc cache allocations, if greater raw page allocation is done.
+#define MAX_KMALLOC_CACHE_ORDER 12
+
+#define KMEM_OBJ_OVERHEAD                    sizeof(kmem_obj)
+#define KMEM_START_OBJ_COUNT                 8
+#define KMEM_MAX_REFILL_OBJ_COUNT            64
+/// Minimum number of objects in a slab, so that a single buddy block serves
+/// several refills of the magazines.
+#define KMEM_MIN_SLAB_OBJ_COUNT 8
+/// Maximum order of the slabs, unless a single object needs more.
+#define KMEM_MAX_SLAB_ORDER 3
+/// Maximum number of slabs allocated, or freed, with a single bulk call.
+#define KMEM_BULK_SLAB_COUNT 16U
+/// Maximum amount of memory, in bytes, kept in a magazine.
+#define KMEM_MAGAZINE_MAX_BYTES (2 * PAGE_SIZE)
+#define KMEM_OBJ(cachep, addr)               ((kmem_obj *)(addr))
+#define ADDR_FROM_KMEM_OBJ(cachep, kmem_obj) ((void *)(kmem_obj))
+
+// The list of caches.
+static list_head kmem_caches_list;
+// Cache where we will store the data about caches.
+static kmem_cache_t kmem_cache;
+// Caches for each order of the malloc.
+static kmem_cache_t *malloc_blocks[MAX_KMALLOC_CACHE_ORDER];
+
+/// @brief Turns a newly allocated block of pages into a free slab of the cache.
+/// @param cachep the cache.
+/// @param page   the first page of the block.
+static void __init_slab_page(kmem_cache_t *cachep, page_t *page)
+{
+    list_head_init(&page->slabs);
+
+    // Save in the root page the kmem_cache_t pointer,
+    // to allow freeing arbitrary pointers
+    page[0].container.slab_cache = cachep;
+
+    // Update slab main pages of all child pages, to allow
+    // reconstructing which page handles a specified address
+    for (unsigned int i = 1; i < (1U << cachep->gfp_order); i++) {
+        page[i].container.slab_main_page = page;
+    }
+
+    unsigned int slab_size = PAGE_SIZE * (1U << cachep->gfp_order);
+
+    // Update the page objects counters
+    page->slab_objcnt  = slab_size / cachep->size;
+    page->slab_objfree = page->slab_objcnt;
+
+    unsigned int pg_addr = get_lowmem_address_from_page(page);
+
+    list_head_init(&page->slab_freelist);
+
+    // Build the objects structures
+    for (unsigned int i = 0; i < page->slab_objcnt; i++) {
+        kmem_obj *obj = KMEM_OBJ(cachep, pg_addr + cachep->size * i);
+        list_head_insert_after(&obj->objlist, &page->slab_freelist);
+    }
+
+    // Add the page to the slab list and update the counters
+    list_head_insert_after(&page->slabs, &cachep->slabs_free);
+    cachep->total_num += page->slab_objcnt;
+    cachep->free_num += page->slab_objcnt;
+}
+
+static void __kmem_cache_refill(kmem_cache_t *cachep, unsigned int free_num, gfp_t flags)
+{
+    page_t *pages[KMEM_BULK_SLAB_COUNT];
+
+    while (cachep->free_num < free_num) {
+        // Take all the missing slabs from the buddy system at once.
+        unsigned int slab_objcnt = (PAGE_SIZE << cachep->gfp_order) / cachep->size;
+        unsigned int count       = (free_num - cachep->free_num + slab_objcnt - 1) / slab_objcnt;
+        count                    = min(count, KMEM_BULK_SLAB_COUNT);
+
+        unsigned int allocated = _alloc_pages_bulk(flags, cachep->gfp_order, count, pages);
+        for (unsigned int i = 0; i < allocated; i++) {
+            __init_slab_page(cachep, pages[i]);
+        }
+        if (allocated < count) {
+            pr_warning("Cannot allocate a page, abort refill\n");
+            break;
+        }
+    }
+}
+
+static unsigned int __find_next_alignment(unsigned int size, unsigned int align)
+{
+    return (size / align + (size % align ? 1 : 0)) * align;
+}
+
+static void __compute_size_and_order(kmem_cache_t *cachep)
+{
+    // Align the whole object to the required padding
+    cachep->size = __find_next_alignment(
+        max(cachep->object_size, KMEM_OBJ_OVERHEAD),
+        max(8, cachep->align));
+
+    // Compute the gfp order, so that a slab is a single buddy block holding
+    // at least KMEM_MIN_SLAB_OBJ_COUNT objects (or at least one, if the
+    // object is too big for that)
+    while (((PAGE_SIZE << cachep->gfp_order) < cachep->size) ||
+           (((PAGE_SIZE << cachep->gfp_order) < (cachep->size * KMEM_MIN_SLAB_OBJ_COUNT)) &&
+            (cachep->gfp_order < KMEM_MAX_SLAB_ORDER))) {
+        cachep->gfp_order++;
+    }
+
+    // Big objects are not worth keeping around in large numbers
+    cachep->magazine_size = max(1, min(KMEM_MAGAZINE_SIZE, KMEM_MAGAZINE_MAX_BYTES / cachep->size));
+}
+
+static void __kmem_cache_create(kmem_cache_t *cachep, const char *name, unsigned int size, unsigned int align, slab_flags_t flags, void (*ctor)(void *), void (*dtor)(void *), unsigned int start_count)
+{
+    pr_info("Creating new cache `%s` with objects of size `%d`.\n", name, size);
+
+    *cachep = (kmem_cache_t){
+        .name        = name,
+        .object_size = size,
+        .align       = align,
+        .flags       = flags,
+        .ctor        = ctor,
+        .dtor        = dtor
+    };
+
+    list_head_init(&cachep->slabs_free);
+    list_head_init(&cachep->slabs_partial);
+    list_head_init(&cachep->slabs_full);
+
+    __compute_size_and_order(cachep);
+
+    __kmem_cache_refill(cachep, start_count, flags);
+
+    list_head_insert_after(&cachep->cache_list, &kmem_caches_list);
+}
+
+static inline void *__kmem_cache_alloc_slab(kmem_cache_t *cachep, page_t *slab_page)
+{
+    list_head *elem_listp = list_head_pop(&slab_page->slab_freelist);
+    if (!elem_listp) {
+        pr_warning("There are no FREE element inside the slab_freelist\n");
+        return NULL;
+    }
+    slab_page->slab_objfree--;
+    cachep->free_num--;
+
+    kmem_obj *obj = list_entry(elem_listp, kmem_obj, objlist);
+
+    // Get the element from the kmem_obj object
+    return ADDR_FROM_KMEM_OBJ(cachep, obj);
+}
+
+/// @brief Detaches a slab from the cache, its pages are then given back to
+/// the zone allocator by the caller.
+/// @param cachep    the cache.
+/// @param slab_page the first page of the slab.
+static inline void __kmem_cache_release_slab(kmem_cache_t *cachep, page_t *slab_page)
+{
+    cachep->free_num -= slab_page->slab_objfree;
+    cachep->total_num -= slab_page->slab_objcnt;
+    // Clear objcnt, used as a flag to check if the page belongs to the slab
+    slab_page->slab_objcnt              = 0;
+    slab_page->container.slab_main_page = NULL;
+
+    // Reset all non-root slab pages
+    for (unsigned int i = 1; i < (1U << cachep->gfp_order); i++) {
+        (slab_page + i)->container.slab_main_page = NULL;
+    }
+}
+
+/// @brief Frees all the slabs of the given list, a batch of blocks at a time.
+/// @param cachep the cache.
+/// @param slabs  the list of slabs.
+static void __kmem_cache_free_slabs(kmem_cache_t *cachep, list_head *slabs)
+{
+    page_t *pages[KMEM_BULK_SLAB_COUNT];
+    unsigned int count = 0;
+
+    while (!list_head_empty(slabs)) {
+        page_t *slab_page = list_entry(list_head_pop(slabs), page_t, slabs);
+        __kmem_cache_release_slab(cachep, slab_page);
+        pages[count++] = slab_page;
+        if (count == KMEM_BULK_SLAB_COUNT) {
+            __free_pages_bulk(pages, count);
+            count = 0;
+        }
+    }
+    if (count) {
+        __free_pages_bulk(pages, count);
+    }
+}
+
+/// @brief Takes an object from the slabs of the cache, allocating a new slab
+/// if they are all full.
+/// @param cachep the cache.
+/// @param flags  the GFP flags used to allocate a new slab.
+/// @return the object, NULL if there is no memory left.
+static void *__kmem_cache_alloc_object(kmem_cache_t *cachep, gfp_t flags)
+{
+    if (list_head_empty(&cachep->slabs_partial)) {
+        if (list_head_empty(&cachep->slabs_free)) {
+            if (flags == 0)
+                flags = cachep->flags;
+
+            // Refill the cache in an exponential fashion, capping at KMEM_MAX_REFILL_OBJ_COUNT to avoid
+            // too big allocations
+            __kmem_cache_refill(cachep, min(cachep->total_num, KMEM_MAX_REFILL_OBJ_COUNT), flags);
+            if (list_head_empty(&cachep->slabs_free)) {
+                pr_crit("Cannot allocate more slabs in `%s`\n", cachep->name);
+                return NULL;
+            }
+        }
+
+        // Add a free slab to partial list because in any case an element will
+        // be removed before the function returns
+        list_head *free_slab = list_head_pop(&cachep->slabs_free);
+        list_head_insert_after(free_slab, &cachep->slabs_partial);
+    }
+
+    page_t *slab_page = list_entry(cachep->slabs_partial.next, page_t, slabs);
+    void *ptr         = __kmem_cache_alloc_slab(cachep, slab_page);
+
+    // If the slab is now full, add it to the full slabs list
+    if (slab_page->slab_objfree == 0) {
+        list_head *slab_full_elem = list_head_pop(&cachep->slabs_partial);
+        list_head_insert_after(slab_full_elem, &cachep->slabs_full);
+    }
+    return ptr;
+}
+
+/// @brief Gives an object back to its slab.
+/// @param cachep    the cache.
+/// @param slab_page the root page of the slab.
+/// @param ptr       the object.
+static void __kmem_cache_free_object(kmem_cache_t *cachep, page_t *slab_page, void *ptr)
+{
+    kmem_obj *obj = KMEM_OBJ(cachep, ptr);
+
+    // Add object to the free list
+    list_head_insert_after(&obj->objlist, &slab_page->slab_freelist);
+    slab_page->slab_objfree++;
+    cachep->free_num++;
+
+    // Now page is completely free
+    if (slab_page->slab_objfree == slab_page->slab_objcnt) {
+        // Remove page from partial list
+        list_head_remove(&slab_page->slabs);
+        // Add page to free list
+        list_head_insert_after(&slab_page->slabs, &cachep->slabs_free);
+    }
+    // Now page is not full, so change its list
+    else if (slab_page->slab_objfree == 1) {
+        // Remove page from full list
+        list_head_remove(&slab_page->slabs);
+        // Add page to partial list
+        list_head_insert_after(&slab_page->slabs, &cachep->slabs_partial);
+    }
+}
+
+/// @brief Returns the root page of the slab containing the object.
+/// @param ptr the object.
+/// @return the root page of the slab.
+static inline page_t *__kmem_slab_page(void *ptr)
+{
+    page_t *slab_page = get_lowmem_page_from_address((uint32_t)ptr);
+
+    // If the slab main page is a lowmem page, change to it as it's the root page
+    if (is_lowmem_page_struct(slab_page->container.slab_main_page)) {
+        slab_page = slab_page->container.slab_main_page;
+    }
+    return slab_page;
+}
+
+/// @brief Fills half of an empty magazine with objects from the slabs.
+/// @param cachep   the cache.
+/// @param magazine the magazine.
+/// @param flags    the GFP flags used to allocate a new slab.
+static inline void __kmem_magazine_refill(kmem_cache_t *cachep, kmem_magazine_t *magazine, gfp_t flags)
+{
+    unsigned int count = max(1, cachep->magazine_size / 2);
+    while (magazine->count < count) {
+        void *ptr = __kmem_cache_alloc_object(cachep, flags);
+        if (!ptr)
+            break;
+        magazine->objects[magazine->count++] = ptr;
+    }
+}
+
+/// @brief Gives the oldest objects of a magazine back to the slabs, the most
+/// recently freed ones are those likely to be in the CPU cache.
+/// @param cachep   the cache.
+/// @param magazine the magazine.
+/// @param count    the number of objects to give back.
+static inline void __kmem_magazine_flush(kmem_cache_t *cachep, kmem_magazine_t *magazine, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        __kmem_cache_free_object(cachep, __kmem_slab_page(magazine->objects[i]), magazine->objects[i]);
+    }
+    magazine->count -= count;
+    for (unsigned int i = 0; i < magazine->count; i++) {
+        magazine->objects[i] = magazine->objects[i + count];
+    }
+}
+
+void kmem_cache_init()
+{
+    // Initialize the list of caches.
+    list_head_init(&kmem_caches_list);
+    // Create a cache to store the data about caches.
+    __kmem_cache_create(
+        &kmem_cache,
+        "kmem_cache_t",
+        sizeof(kmem_cache_t),
+        alignof(kmem_cache_t),
+        GFP_KERNEL,
+        NULL,
+        NULL, 32);
+    for (unsigned int i = 0; i < MAX_KMALLOC_CACHE_ORDER; i++) {
+        malloc_blocks[i] = kmem_cache_create(
+            "kmalloc",
+            1u << i,
+            1u << i,
+            GFP_KERNEL,
+            NULL,
+            NULL);
+    }
+}
+
+kmem_cache_t *kmem_cache_create(const char *name, unsigned int size, unsigned int align, slab_flags_t flags, void (*ctor)(void *), void (*dtor)(void *))
+{
+    kmem_cache_t *cachep = (kmem_cache_t *)kmem_cache_alloc(&kmem_cache, GFP_KERNEL);
+    if (!cachep)
+        return cachep;
+
+    __kmem_cache_create(cachep, name, size, align, flags, ctor, dtor, KMEM_START_OBJ_COUNT);
+
+    return cachep;
+}
+
+void kmem_cache_reserve(kmem_cache_t *cachep, unsigned int count, gfp_t flags)
+{
+    if (flags == 0)
+        flags = cachep->flags;
+    __kmem_cache_refill(cachep, count, flags);
+}
+
+void kmem_cache_destroy(kmem_cache_t *cachep)
+{
+    // Give the objects kept by the CPUs back to the slabs.
+    for (unsigned int cpu = 0; cpu < BB_MAX_CPUS; cpu++) {
+        __kmem_magazine_flush(cachep, &cachep->magazines[cpu], cachep->magazines[cpu].count);
+    }
+
+    __kmem_cache_free_slabs(cachep, &cachep->slabs_free);
+    __kmem_cache_free_slabs(cachep, &cachep->slabs_partial);
+    __kmem_cache_free_slabs(cachep, &cachep->slabs_full);
+
+    // Unlink the cache before freeing it, its memory is reused for the
+    // free list of the slab.
+    list_head_remove(&cachep->cache_list);
+    kmem_cache_free(cachep);
+}
+
+void kmem_cache_dump()
+{
+    pr_debug("%-16s %6s %6s %6s %5s %9s %9s %9s %9s\n",
+             "cache", "size", "total", "free", "order", "a-hits", "a-misses", "f-hits", "f-misses");
+    list_for_each_decl(it, &kmem_caches_list)
+    {
+        kmem_cache_t *cachep = list_entry(it, kmem_cache_t, cache_list);
+        pr_debug("%-16s %6u %6u %6u %5u %9u %9u %9u %9u\n",
+                 cachep->name, cachep->size, cachep->total_num, cachep->free_num, cachep->gfp_order,
+                 cachep->alloc_hits, cachep->alloc_misses, cachep->free_hits, cachep->free_misses);
+        for (unsigned int cpu = 0; cpu < BB_MAX_CPUS; cpu++) {
+            pr_debug("    cpu %u magazine: %2u/%2u objects\n", cpu, cachep->magazines[cpu].count, cachep->magazine_size);
+        }
+    }
+}
+
+size_t kmem_cache_read_stats(char *buffer, size_t bufsize)
+{
+    char line[192];
+    size_t length = 0;
+    list_for_each_decl(it, &kmem_caches_list)
+    {
+        kmem_cache_t *cachep = list_entry(it, kmem_cache_t, cache_list);
+        unsigned int cached  = 0;
+        for (unsigned int cpu = 0; cpu < BB_MAX_CPUS; cpu++) {
+            cached += cachep->magazines[cpu].count;
+        }
+        size_t line_length = sprintf(line, "slab %s size %u total %u free %u cached %u alloc_hits %u alloc_misses %u free_hits %u free_misses %u\n",
+                                     cachep->name, cachep->size, cachep->total_num, cachep->free_num, cached,
+                                     cachep->alloc_hits, cachep->alloc_misses, cachep->free_hits, cachep->free_misses);
+        // The caches which do not fit are left out.
+        if ((length + line_length + 1) > bufsize) {
+            break;
+        }
+        memcpy(buffer + length, line, line_length + 1);
+        length += line_length;
+    }
+    return length;
+}
+
+#ifdef ENABLE_CACHE_TRACE
+void *pr_kmem_cache_alloc(const char *file, const char *fun, int line, kmem_cache_t *cachep, gfp_t flags)
+#else
+void *kmem_cache_alloc(kmem_cache_t *cachep, gfp_t flags)
+#endif
+{
+    kmem_magazine_t *magazine = &cachep->magazines[bb_current_cpu()];
+    void *ptr                 = NULL;
+
+    // Most allocations are served by the magazine of the CPU
+    if (magazine->count) {
+        cachep->alloc_hits++;
+    } else {
+        cachep->alloc_misses++;
+        __kmem_magazine_refill(cachep, magazine, flags);
+    }
+    if (magazine->count) {
+        ptr = magazine->objects[--magazine->count];
+        if (cachep->ctor)
+            cachep->ctor(ptr);
+    }
+#ifdef ENABLE_CACHE_TRACE
+    pr_notice("CHACE-ALLOC 0x%p in %-20s at %s:%d\n", ptr, cachep->name, file, line);
+#endif
+    return ptr;
+}
+
+#ifdef ENABLE_CACHE_TRACE
+void pr_kmem_cache_free(const char *file, const char *fun, int line, void *ptr)
+#else
+void kmem_cache_free(void *ptr)
+#endif
+{
+    kmem_cache_t *cachep = __kmem_slab_page(ptr)->container.slab_cache;
+
+#ifdef ENABLE_CACHE_TRACE
+    pr_notice("CHACE-FREE  0x%p in %-20s at %s:%d\n", ptr, cachep->name, file, line);
+#endif
+    if (cachep->dtor)
+        cachep->dtor(ptr);
+
+    kmem_magazine_t *magazine = &cachep->magazines[bb_current_cpu()];
+
+    // Most frees find room in the magazine of the CPU
+    if (magazine->count < cachep->magazine_size) {
+        cachep->free_hits++;
+    } else {
+        cachep->free_misses++;
+        __kmem_magazine_flush(cachep, magazine, max(1, magazine->count / 2));
+    }
+    magazine->objects[magazine->count++] = ptr;
+}
+
+#ifdef ENABLE_ALLOC_TRACE
+void *pr_kmalloc(const char *file, const char *fun, int line, unsigned int size)
+#else
+void *kmalloc(unsigned int size)
+#endif
+{
+    unsigned int order = 0;
+    while (size != 0) {
+        order++;
+        size /= 2;
+    }
+
+    // If size does not fit in the maximum cache order, allocate raw pages
+    void *ptr;
+    if (order >= MAX_KMALLOC_CACHE_ORDER) {
+        ptr = (void *)__alloc_pages_lowmem(GFP_KERNEL, order - 12);
+    } else {
+        ptr = kmem_cache_alloc(malloc_blocks[order], GFP_KERNEL);
+    }
+#ifdef ENABLE_ALLOC_TRACE
+    pr_notice("KMALLOC 0x%p at %s:%d\n", ptr, file, line);
+#endif
+    return ptr;
+}
+
+#ifdef ENABLE_ALLOC_TRACE
+void pr_kfree(const char *file, const char *fun, int line, void *ptr)
+#else
+void kfree(void *ptr)
+#endif
+{
+#ifdef ENABLE_ALLOC_TRACE
+    pr_notice("KFREE   0x%p at %s:%d\n", ptr, file, line);
+#endif
+    page_t *page = get_lowmem_page_from_address((uint32_t)ptr);
+
+    // If the address is part of the cache
+    if (page->container.slab_main_page) {
+        kmem_cache_free(ptr);
+    } else {
+        free_pages_lowmem((uint32_t)ptr);
+    }
+}
@@ -0,0 +1,118 @@
+/// @file wait.c
+/// @brief wait functions.
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Include the kernel log levels.
+#include "sys/kernel_levels.h"
+/// Change the header.
+#define __DEBUG_HEADER__ "[WAIT  ]"
+/// Set the log level.
+#define __DEBUG_LEVEL__ LOGLEVEL_NOTICE
+
+#include "process/wait.h"
+#include "process/scheduler.h"
+#include "mem/slab.h"
+#include "sys/errno.h"
+
+static inline void __add_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq)
+{
+    list_head_insert_before(&wq->task_list, &head->task_list);
+}
+
+static inline void __remove_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq)
+{
+    list_head_remove(&wq->task_list);
+}
+
+void init_waitqueue_entry(wait_queue_entry_t *wq, struct task_struct *task)
+{
+    wq->flags = 0;
+    wq->task  = task;
+    wq->func  = default_wake_function;
+}
+
+void add_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq)
+{
+    wq->flags &= ~WQ_FLAG_EXCLUSIVE;
+    spinlock_lock(&head->lock);
+    __add_wait_queue(head, wq);
+    spinlock_unlock(&head->lock);
+}
+
+void remove_wait_queue(wait_queue_head_t *head, wait_queue_entry_t *wq)
+{
+    spinlock_lock(&head->lock);
+    __remove_wait_queue(head, wq);
+    // The owner keeps only what the remaining waiters give it.
+    if (head->owner) {
+        scheduler_reinherit(head->owner);
+    }
+    spinlock_unlock(&head->lock);
+}
+
+void wait_queue_set_owner(wait_queue_head_t *head, struct task_struct *owner)
+{
+    spinlock_lock(&head->lock);
+    struct task_struct *previous = head->owner;
+    if (previous != owner) {
+        if (previous) {
+            // Unlink the queue from the ones of the previous owner.
+            wait_queue_head_t **it = &previous->se.pi_owned;
+            while (*it != head) {
+                it = &(*it)->owned_next;
+            }
+            *it              = head->owned_next;
+            head->owned_next = NULL;
+        }
+        head->owner = owner;
+        if (owner) {
+            head->owned_next   = owner->se.pi_owned;
+            owner->se.pi_owned = head;
+        }
+        if (previous) {
+            scheduler_reinherit(previous);
+        }
+        if (owner) {
+            scheduler_reinherit(owner);
+        }
+    }
+    spinlock_unlock(&head->lock);
+}
+
+int wait_queue_lock(wait_queue_head_t *head)
+{
+    struct task_struct *current = scheduler_get_current_process();
+    // The lock might have been handed to the task while it was sleeping.
+    if (head->owner == current) {
+        return 0;
+    }
+    if (head->owner == NULL) {
+        wait_queue_set_owner(head, current);
+        return 0;
+    }
+    sleep_on(head);
+    return -EAGAIN;
+}
+
+int wait_queue_unlock(wait_queue_head_t *head)
+{
+    if (head->owner != scheduler_get_current_process()) {
+        return -EPERM;
+    }
+    wait_queue_entry_t *wait = NULL;
+    spinlock_lock(&head->lock);
+    if (!list_head_empty(&head->task_list)) {
+        wait = list_entry(head->task_list.next, wait_queue_entry_t, task_list);
+        __remove_wait_queue(head, wait);
+    }
+    spinlock_unlock(&head->lock);
+    // The first waiter holds the lock before it runs again, and it inherits
+    // from the ones behind it.
+    wait_queue_set_owner(head, wait ? wait->task : NULL);
+    if (wait) {
+        wait->func(wait, 0, 0);
+        kfree(wait);
+    }
+    return 0;
+}
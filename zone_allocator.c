@@ -0,0 +1,1121 @@
+/// @file zone_allocator.c
+/// @brief Implementation of the Zone Allocator
+/// @copyright (c) 2014-2022 This file is distributed under the MIT License.
+/// See LICENSE.md for details.
+
+// Include the kernel log levels.
+#include "sys/kernel_levels.h"
+/// Change the header.
+#define __DEBUG_HEADER__ "[PMM   ]"
+/// Set the log level.
+#define __DEBUG_LEVEL__ LOGLEVEL_NOTICE
+
+#include "mem/zone_allocator.h"
+#include "mem/buddysystem.h"
+#include "klib/list_head.h"
+#include "kernel.h"
+#include "assert.h"
+#include "mem/paging.h"
+#include "mem/vmem_map.h"
+#include "mem/slab.h"
+#include "hardware/timer.h"
+#include "klib/irqflags.h"
+#include "string.h"
+#include "io/debug.h"
+#include "system/panic.h"
+
+/// TODO: Comment.
+#define MIN_PAGE_ALIGN(addr) ((addr) & (~(PAGE_SIZE - 1)))
+/// TODO: Comment.
+#define MAX_PAGE_ALIGN(addr) (((addr) & (~(PAGE_SIZE - 1))) + PAGE_SIZE)
+/// TODO: Comment.
+#define MAX_ORDER_ALIGN(addr)                                             \
+    (((addr) & (~((PAGE_SIZE << (MAX_BUDDYSYSTEM_GFP_ORDER - 1)) - 1))) + \
+     (PAGE_SIZE << (MAX_BUDDYSYSTEM_GFP_ORDER - 1)))
+
+/// Size of the region of ZONE_NORMAL reserved to the contiguous allocations.
+#ifndef ZONE_RESERVED_SIZE
+#define ZONE_RESERVED_SIZE (16U * M)
+#endif
+
+/// Fill the pages with the memset of the kernel instead of `rep stosl`, to
+/// compare the two through the zero_cycles_per_page of /proc/buddyinfo.
+#ifndef ZONE_ZERO_WITH_MEMSET
+#define ZONE_ZERO_WITH_MEMSET 0
+#endif
+/// Number of pages zeroed in the background at each run of the refill timer.
+#ifndef ZONE_PREZERO_BATCH
+#define ZONE_PREZERO_BATCH 8
+#endif
+/// Ticks between two runs of the refill timer.
+#ifndef ZONE_PREZERO_TICKS
+#define ZONE_PREZERO_TICKS 1
+#endif
+/// The byte freed pages are filled with in the debug mode of the buddy system.
+#define ZONE_POISON_BYTE 0xAA
+/// Run the allocator benchmark at boot, once the zones are set up, and print
+/// its results in the format of memtest (one `key=value` record per line).
+#ifndef ZONE_BENCHMARK
+#define ZONE_BENCHMARK 0
+#endif
+/// Allocate and free from the timer interrupt, once the ticks start, to stress
+/// the locking of the buddy system while memtest runs in the processes.
+#ifndef ZONE_STRESS_IRQ
+#define ZONE_STRESS_IRQ 0
+#endif
+/// Number of blocks handed to the buddy system by each call of the bulk functions.
+#define ZONE_BULK_BATCH 32U
+
+/// Array of all physical blocks
+page_t *mem_map = NULL;
+/// Memory node.
+pg_data_t *contig_page_data = NULL;
+/// Low memory virtual base address.
+uint32_t lowmem_virt_base = 0;
+/// Low memory base address.
+uint32_t lowmem_page_base = 0;
+/// Zones whose zeroed pages refill timer is armed (bit i <=> zone i).
+static uint32_t prezero_armed = 0;
+
+page_t *get_lowmem_page_from_address(uint32_t addr)
+{
+    unsigned int offset = addr - lowmem_virt_base;
+    return mem_map + lowmem_page_base + (offset / PAGE_SIZE);
+}
+
+uint32_t get_lowmem_address_from_page(page_t *page)
+{
+    unsigned int offset = (page - mem_map) - lowmem_page_base;
+    return lowmem_virt_base + offset * PAGE_SIZE;
+}
+
+uint32_t get_physical_address_from_page(page_t *page)
+{
+    return (page - mem_map) * PAGE_SIZE;
+}
+
+page_t *get_page_from_physical_address(uint32_t phy_addr)
+{
+    return mem_map + (phy_addr / PAGE_SIZE);
+}
+
+/// @brief Get the zone that contains a page frame.
+/// @param page A page descriptor.
+/// @return The zone requested.
+static zone_t *get_zone_from_page(page_t *page)
+{
+    zone_t *zone;
+    page_t *last_page;
+    // Iterate over all the zones.
+    for (int zone_index = 0; zone_index < contig_page_data->nr_zones; zone_index++) {
+        // Get the zone at the given index.
+        zone = contig_page_data->node_zones + zone_index;
+        assert(zone && "Failed to retrieve the zone.");
+        // Get the last page of the zone.
+        last_page = zone->zone_mem_map + zone->size;
+        assert(last_page && "Failed to retrieve the last page of the zone.");
+        // Check if the page is before the last page of the zone.
+        if (page < last_page)
+            return zone;
+    }
+    // Error: page is over memory size.
+    return (zone_t *)NULL;
+}
+
+/// @brief Get a zone from gfp_mask
+/// @param gfp_mask GFP_FLAG see gfp.h.
+/// @return The zone requested.
+static zone_t *get_zone_from_flags(gfp_t gfp_mask)
+{
+    // The action and mobility modifiers do not select the zone.
+    switch (gfp_mask & ~(__GFP_ZERO | GFP_MOVABLE_MASK)) {
+    case GFP_KERNEL:
+    case GFP_ATOMIC:
+    case GFP_NOFS:
+    case GFP_NOIO:
+    case GFP_NOWAIT:
+        return &contig_page_data->node_zones[ZONE_NORMAL];
+    case GFP_HIGHUSER:
+        return &contig_page_data->node_zones[ZONE_HIGHMEM];
+    default:
+        return (zone_t *)NULL;
+    }
+}
+
+/// @brief Get the mobility class of the pages from gfp_mask.
+/// @param gfp_mask GFP_FLAG see gfp.h.
+/// @return The mobility class the pages are taken from.
+static inline bb_migrate_type_t get_migrate_type_from_flags(gfp_t gfp_mask)
+{
+    if (gfp_mask & __GFP_MOVABLE) {
+        return BB_MIGRATE_MOVABLE;
+    }
+    if (gfp_mask & __GFP_RECLAIMABLE) {
+        return BB_MIGRATE_RECLAIMABLE;
+    }
+    // Only user pages come from the high memory, the kernel reaches it
+    // through temporary mappings.
+    if (gfp_mask & __GFP_HIGHMEM) {
+        return BB_MIGRATE_MOVABLE;
+    }
+    return BB_MIGRATE_UNMOVABLE;
+}
+
+static int is_memory_clean(gfp_t gfp_mask)
+{
+    // Get the corresponding zone.
+    zone_t *zone = get_zone_from_flags(gfp_mask);
+    assert(zone && "Failed to retrieve the zone given the gfp_mask!");
+    // Get the last free area list of the buddy system.
+    bb_free_area_t *area = zone->buddy_system.free_area + (MAX_BUDDYSYSTEM_GFP_ORDER - 1);
+    assert(area && "Failed to retrieve the last free_area for the given zone!");
+    // Compute the total size of the zone.
+    unsigned int total_size = (zone->size / (1UL << (MAX_BUDDYSYSTEM_GFP_ORDER - 1)));
+    // Check if the size of the zone is equal to the remaining pages inside the free area.
+    if (area->nr_free != total_size) {
+        pr_crit("Number of blocks of free pages is different than expected (%d vs %d).\n", area->nr_free, total_size);
+        buddy_system_dump(&zone->buddy_system);
+        return 0;
+    }
+    return 1;
+}
+
+/// @brief Reads the lower half of the CPU time-stamp counter.
+/// @return the lower 32 bits of the number of cycles since the CPU has been reset.
+static inline uint32_t __zone_rdtsc(void)
+{
+    uint32_t low;
+    __asm__ __volatile__("rdtsc"
+                         : "=a"(low)
+                         :
+                         : "edx");
+    return low;
+}
+
+/// @brief  Checks if the physical memory manager is working properly.
+/// @return If the check was done correctly.
+static int pmm_check()
+{
+    pr_debug(
+        "\n=================== ZONE ALLOCATOR TEST ==================== \n");
+
+    pr_debug("\t[STEP1] One page frame in kernel-space... ");
+    pr_debug("\n\t ===== [STEP1] One page frame in kernel-space ====\n");
+    pr_debug("\n\t ----- ALLOC -------------------------------------\n");
+    uint32_t ptr1 = __alloc_page_lowmem(GFP_KERNEL);
+    pr_debug("\n\t ----- FREE --------------------------------------\n");
+    free_page_lowmem(ptr1);
+    if (!is_memory_clean(GFP_KERNEL)) {
+        pr_emerg("Test failed, memory is not clean.\n");
+        return 0;
+    }
+
+    pr_debug("\t[STEP2] Five page frames in user-space... ");
+    pr_debug("\n\t ===== [STEP2] Five page frames in user-space ====\n");
+    page_t *ptr2[5];
+    for (int i = 0; i < 5; i++) {
+        ptr2[i] = _alloc_pages(GFP_HIGHUSER, 0);
+    }
+    for (int i = 0; i < 5; i++) {
+        __free_pages(ptr2[i]);
+    }
+    if (!is_memory_clean(GFP_HIGHUSER)) {
+        pr_emerg("Test failed, memory is not clean.\n");
+        return 0;
+    }
+
+    pr_debug("\t[STEP3] 2^{3} page frames in kernel-space... ");
+    pr_debug("\n\t ===== [STEP3] 2^{3} page frames in kernel-space ====\n");
+    uint32_t ptr3 = __alloc_pages_lowmem(GFP_KERNEL, 3);
+    free_pages_lowmem(ptr3);
+    if (!is_memory_clean(GFP_KERNEL)) {
+        pr_emerg("Test failed, memory is not clean.\n");
+        return 0;
+    }
+
+    pr_debug("\t[STEP4] Five 2^{i} page frames in user-space... ");
+    pr_debug("\n\t ===== [STEP4] Five 2^{i} page frames in user-space ====\n");
+    page_t *ptr4[5];
+    for (int i = 0; i < 5; i++) {
+        ptr4[i] = _alloc_pages(GFP_HIGHUSER, i);
+    }
+    for (int i = 0; i < 5; i++) {
+        __free_pages(ptr4[i]);
+    }
+    if (!is_memory_clean(GFP_HIGHUSER)) {
+        pr_emerg("Test failed, memory is not clean.\n");
+        return 0;
+    }
+
+    pr_debug("\t[STEP5] Mixed page frames in kernel-space... ");
+    pr_debug("\n\t ===== [STEP5] Mixed page frames in kernel-space ====\n");
+    int **ptr = (int **)__alloc_page_lowmem(GFP_KERNEL);
+    int i     = 0;
+    for (; i < 5; ++i) {
+        ptr[i] = (int *)__alloc_page_lowmem(GFP_KERNEL);
+    }
+    for (; i < 20; ++i) {
+        ptr[i] = (int *)__alloc_pages_lowmem(GFP_KERNEL, 2);
+    }
+
+    int j = 0;
+    for (; j < 5; ++j) {
+        free_page_lowmem((uint32_t)ptr[j]);
+    }
+    for (; j < 20; ++j) {
+        free_pages_lowmem((uint32_t)ptr[j]);
+    }
+    free_page_lowmem((uint32_t)ptr1);
+
+    if (!is_memory_clean(GFP_KERNEL)) {
+        pr_emerg("Test failed, memory is not clean.\n");
+        return 0;
+    }
+    return 1;
+}
+
+#if ZONE_BENCHMARK
+/// The number of operations of each step of the benchmark.
+#define ZONE_BENCHMARK_ROUNDS 256
+/// The number of live allocations of the random-lifetime workload.
+#define ZONE_BENCHMARK_SLOTS 64
+/// The number of single pages the fragmented workload punches its holes in.
+#define ZONE_BENCHMARK_FRAG_PAGES 1024
+
+/// The latencies of the current workload, in TSC cycles.
+static uint32_t bench_samples[2 * ZONE_BENCHMARK_ROUNDS];
+/// The number of latencies.
+static uint32_t bench_count;
+/// The blocks held by the current workload.
+static bb_page_t *bench_pages[ZONE_BENCHMARK_ROUNDS];
+/// The single pages held by the fragmented workload.
+static bb_page_t *bench_held[ZONE_BENCHMARK_FRAG_PAGES];
+/// The burst sizes of the cached single pages.
+static const uint32_t bench_bursts[] = { 1, 8, 32, 128 };
+/// The state of the pseudo-random generator of the benchmark.
+static uint32_t bench_seed = 1;
+/// The buffer the statistics of the buddy system are printed from.
+static char bench_buffer[PAGE_SIZE];
+
+/// @brief Returns a pseudo-random number, the same sequence at every boot.
+static inline uint32_t __bench_rand(void)
+{
+    bench_seed = (bench_seed * 1103515245U) + 12345U;
+    return bench_seed >> 16;
+}
+
+/// @brief Records the latency of an operation started at the given time.
+/// @param start the time stamp taken before the operation.
+static inline void __bench_record(uint32_t start)
+{
+    uint32_t cycles = __zone_rdtsc() - start;
+    if (bench_count < (2 * ZONE_BENCHMARK_ROUNDS)) {
+        bench_samples[bench_count++] = cycles;
+    }
+}
+
+/// @brief Prints the results of the workload, and starts the next one.
+/// The arithmetic is on 32 bits, the kernel has no 64-bit division.
+/// @param workload the name of the workload.
+/// @param arg      the parameter of the workload (the order, or the burst).
+static void __bench_report(const char *workload, uint32_t arg)
+{
+    uint32_t n = bench_count, total = 0;
+    bench_count = 0;
+    if (n == 0) {
+        return;
+    }
+    for (uint32_t i = 1; i < n; ++i) {
+        uint32_t value = bench_samples[i], j = i;
+        for (; (j > 0) && (bench_samples[j - 1] > value); --j) {
+            bench_samples[j] = bench_samples[j - 1];
+        }
+        bench_samples[j] = value;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        total = ((total + bench_samples[i]) < total) ? 0xFFFFFFFFU : (total + bench_samples[i]);
+    }
+    uint32_t avg = total / n;
+    pr_notice("pmmbench workload=%s arg=%u ops=%u avg=%u ops_per_mcycle=%u p50=%u p99=%u max=%u\n",
+              workload, arg, n, avg, avg ? (1U << 20) / avg : 0,
+              bench_samples[(50 * (n - 1)) / 100], bench_samples[(99 * (n - 1)) / 100], bench_samples[n - 1]);
+}
+
+/// @brief Prints the statistics of the buddy system of the zone, as in
+/// /proc/buddyinfo, with each line tagged.
+/// @param zone the zone.
+/// @param when the tag, before or after.
+static void __bench_snapshot(zone_t *zone, const char *when)
+{
+    size_t length = buddy_system_read_stats(&zone->buddy_system, bench_buffer, PAGE_SIZE);
+    char *line    = bench_buffer;
+    for (size_t i = 0; i < length; ++i) {
+        if (bench_buffer[i] == '\n') {
+            bench_buffer[i] = 0;
+            pr_notice("pmmbench snapshot=%s %s\n", when, line);
+            line = bench_buffer + i + 1;
+        }
+    }
+}
+
+/// @brief Benchmarks the buddy system of the normal zone: allocations and
+/// frees of every order, bursts of cached single pages, allocations of
+/// random order and random lifetime, and allocations in a zone fragmented
+/// at several levels. Everything is freed at the end.
+static void pmm_benchmark(void)
+{
+    zone_t *zone         = &contig_page_data->node_zones[ZONE_NORMAL];
+    bb_instance_t *buddy = &zone->buddy_system;
+    uint32_t start, count;
+
+    __bench_snapshot(zone, "before");
+
+    // Allocations of each order, fewer of the larger ones and no more than the
+    // zone has, then the frees.
+    for (uint32_t order = 0; order < MAX_BUDDYSYSTEM_GFP_ORDER; ++order) {
+        for (count = 0; count < (ZONE_BENCHMARK_ROUNDS >> (order / 2)); ++count) {
+            start              = __zone_rdtsc();
+            bench_pages[count] = bb_alloc_pages(buddy, order);
+            __bench_record(start);
+            if (!bench_pages[count]) {
+                break;
+            }
+        }
+        __bench_report("alloc_order", order);
+        for (uint32_t i = 0; i < count; ++i) {
+            start = __zone_rdtsc();
+            bb_free_pages(buddy, bench_pages[i]);
+            __bench_record(start);
+        }
+        __bench_report("free_order", order);
+    }
+
+    // Bursts of single pages through the per-cpu cache.
+    for (uint32_t b = 0; b < (sizeof(bench_bursts) / sizeof(bench_bursts[0])); ++b) {
+        for (uint32_t round = 0; round < (ZONE_BENCHMARK_ROUNDS / bench_bursts[b]); ++round) {
+            for (count = 0; count < bench_bursts[b]; ++count) {
+                start              = __zone_rdtsc();
+                bench_pages[count] = bb_alloc_page_cached(buddy);
+                __bench_record(start);
+                if (!bench_pages[count]) {
+                    break;
+                }
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                start = __zone_rdtsc();
+                bb_free_page_cached(buddy, bench_pages[i]);
+                __bench_record(start);
+            }
+        }
+        __bench_report("cached_burst", bench_bursts[b]);
+    }
+
+    // Allocations of random order, up to 2^4 pages, with a random lifetime.
+    for (uint32_t i = 0; i < ZONE_BENCHMARK_SLOTS; ++i) {
+        bench_pages[i] = NULL;
+    }
+    for (uint32_t i = 0; i < (2 * ZONE_BENCHMARK_ROUNDS); ++i) {
+        uint32_t slot = __bench_rand() % ZONE_BENCHMARK_SLOTS;
+        start         = __zone_rdtsc();
+        if (bench_pages[slot]) {
+            bb_free_pages(buddy, bench_pages[slot]);
+            bench_pages[slot] = NULL;
+        } else {
+            bench_pages[slot] = bb_alloc_pages(buddy, __bench_rand() % 5);
+        }
+        __bench_record(start);
+    }
+    __bench_report("lifetime", ZONE_BENCHMARK_SLOTS);
+    for (uint32_t i = 0; i < ZONE_BENCHMARK_SLOTS; ++i) {
+        if (bench_pages[i]) {
+            bb_free_pages(buddy, bench_pages[i]);
+        }
+    }
+
+    // Allocations of random order, up to 2^4 pages, while 0, 1, 2 or 3 single
+    // pages out of every 4 are held, so that the freed ones cannot merge and
+    // the lists of the small orders fill up. Build with BB_SCAN_FREE_LISTS=1
+    // to compare the free_orders mask with the scan of the lists, the
+    // alloc_latency_log2_cycles of the after snapshot cover the whole run.
+    for (uint32_t level = 0; level < 4; ++level) {
+        for (count = 0; count < ZONE_BENCHMARK_FRAG_PAGES; ++count) {
+            if (!(bench_held[count] = bb_alloc_pages(buddy, 0))) {
+                break;
+            }
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            if ((i % 4) >= level) {
+                bb_free_pages(buddy, bench_held[i]);
+                bench_held[i] = NULL;
+            }
+        }
+        for (uint32_t i = 0; i < ZONE_BENCHMARK_ROUNDS; ++i) {
+            start          = __zone_rdtsc();
+            bench_pages[i] = bb_alloc_pages(buddy, __bench_rand() % 5);
+            __bench_record(start);
+        }
+        for (uint32_t i = 0; i < ZONE_BENCHMARK_ROUNDS; ++i) {
+            if (bench_pages[i]) {
+                bb_free_pages(buddy, bench_pages[i]);
+            }
+        }
+        __bench_report("fragmented", 25 * level);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (bench_held[i]) {
+                bb_free_pages(buddy, bench_held[i]);
+            }
+        }
+    }
+
+    __bench_snapshot(zone, "after");
+}
+#endif
+
+/// @brief Initializes the memory attributes.
+/// @param name       Zone's name.
+/// @param zone_index Zone's index.
+/// @param adr_from   the lowest address of the zone
+/// @param adr_to     the highest address of the zone (not included!)
+/// @param reserved   the bytes reserved to the contiguous allocations.
+static void zone_init(char *name, int zone_index, uint32_t adr_from, uint32_t adr_to, uint32_t reserved)
+{
+    assert((adr_from < adr_to) && "Inserted bad block addresses!");
+    assert(((adr_from & 0xfffff000) == adr_from) && "Inserted bad block addresses!");
+    assert(((adr_to & 0xfffff000) == adr_to) && "Inserted bad block addresses!");
+    assert((zone_index < contig_page_data->nr_zones) && "The index is above the number of zones.");
+    // Take the zone_t structure that correspondes to the zone_index.
+    zone_t *zone = contig_page_data->node_zones + zone_index;
+    assert(zone && "Failed to retrieve the zone.");
+    // Number of page frames in the zone.
+    size_t num_page_frames = (adr_to - adr_from) / PAGE_SIZE;
+    // Index of the first page frame of the zone.
+    uint32_t first_page_frame = adr_from / PAGE_SIZE;
+    // Update zone info.
+    zone->name           = name;
+    zone->size           = num_page_frames;
+    zone->free_pages     = num_page_frames;
+    zone->zone_mem_map   = mem_map + first_page_frame;
+    zone->zone_start_pfn = first_page_frame;
+    // Dump the information.
+    pr_debug("ZONE %s, first page: %p, last page: %p, npages:%d\n", zone->name,
+             zone->zone_mem_map, zone->zone_mem_map + zone->size, zone->size);
+    // Set to zero all page structures.
+    memset(zone->zone_mem_map, 0, zone->size * sizeof(page_t));
+    // Initialize the buddy system for the new zone.
+    buddy_system_init_reserved(&zone->buddy_system,
+                               name,
+                               zone->zone_mem_map,
+                               BBSTRUCT_OFFSET(page_t, bbpage),
+                               sizeof(page_t),
+                               num_page_frames,
+                               reserved / PAGE_SIZE);
+    buddy_system_dump(&zone->buddy_system);
+}
+
+/*
+ * AAAABBBBCCCC
+ *    ZZZZZZ
+ *
+ * */
+
+unsigned int find_nearest_order_greater(uint32_t base_addr, uint32_t amount)
+{
+    uint32_t start_pfn = base_addr / PAGE_SIZE;
+    uint32_t end_pfn   = (base_addr + amount + PAGE_SIZE - 1) / PAGE_SIZE;
+    // Get the number of pages.
+    uint32_t npages = end_pfn - start_pfn;
+    // Find the fitting order.
+    unsigned int order = 0;
+    while ((1UL << order) < npages) {
+        ++order;
+    }
+    return order;
+}
+
+int pmmngr_init(boot_info_t *boot_info)
+{
+    //=======================================================================
+
+    uint32_t lowmem_phy_start = boot_info->lowmem_phy_start;
+
+    // Now we have skipped all modules in physical space, is time to
+    // consider also virtual lowmem space!
+    uint32_t lowmem_virt_start = boot_info->lowmem_start + (lowmem_phy_start - boot_info->lowmem_phy_start);
+
+    pr_debug("Start memory address after skip modules (phy => virt) : 0x%p => 0x%p \n",
+             lowmem_phy_start, lowmem_virt_start);
+    //=======================================================================
+
+    //==== Initialize array of page_t =======================================
+    pr_debug("Initializing low memory map structure...\n");
+    mem_map = (page_t *)lowmem_virt_start;
+
+    uint32_t mem_size = boot_info->highmem_phy_end;
+
+    // Total number of blocks (all lowmem+highmem RAM).
+    uint32_t mem_num_frames = mem_size / PAGE_SIZE;
+
+    // Initialize each page_t.
+    for (int page_index = 0; page_index < mem_num_frames; ++page_index) {
+        page_t *page = mem_map + page_index;
+        // Mark page as free.
+        set_page_count(page, 0);
+    }
+    //=======================================================================
+
+    //==== Skip memory space used for page_t[] ==============================
+    lowmem_phy_start += sizeof(page_t) * mem_num_frames;
+    lowmem_virt_start += sizeof(page_t) * mem_num_frames;
+    pr_debug("Size of mem_map                            : %i byte [0x%p - 0x%p]\n",
+             (char *)lowmem_virt_start - (char *)mem_map, mem_map,
+             lowmem_virt_start);
+    //=======================================================================
+
+    //==== Initialize contig_page_data node =================================
+    pr_debug("Initializing contig_page_data node...\n");
+    contig_page_data = (pg_data_t *)lowmem_virt_start;
+    // ZONE_NORMAL and ZONE_HIGHMEM
+    contig_page_data->nr_zones = __MAX_NR_ZONES;
+    // NID start from 0.
+    contig_page_data->node_id = 0;
+    // Corresponds with mem_map.
+    contig_page_data->node_mem_map = mem_map;
+    // In UMA we have only one node.
+    contig_page_data->node_next = NULL;
+    // All the memory.
+    contig_page_data->node_size = mem_num_frames;
+    // mem_map[0].
+    contig_page_data->node_start_mapnr = 0;
+    // The first physical page.
+    contig_page_data->node_start_paddr = 0x0;
+    //=======================================================================
+
+    //==== Skip memory space used for pg_data_t =============================
+    lowmem_phy_start += sizeof(pg_data_t);
+    lowmem_virt_start += sizeof(pg_data_t);
+    //=======================================================================
+
+    //==== Initialize zones zone_t ==========================================
+    pr_debug("Initializing zones...\n");
+
+    // ZONE_NORMAL   [ memory_start - mem_size/4 ]
+    uint32_t start_normal_addr = MAX_PAGE_ALIGN(lowmem_phy_start);
+    uint32_t stop_normal_addr  = MIN_PAGE_ALIGN(boot_info->lowmem_phy_end);
+
+    uint32_t phv_delta = start_normal_addr - lowmem_phy_start;
+    lowmem_virt_base   = lowmem_virt_start + phv_delta;
+    lowmem_page_base   = start_normal_addr / PAGE_SIZE;
+    zone_init("Normal", ZONE_NORMAL, start_normal_addr, stop_normal_addr, ZONE_RESERVED_SIZE);
+
+    // ZONE_HIGHMEM  [ mem_size/4 - mem_size ]
+    uint32_t start_high_addr = MAX_PAGE_ALIGN((uint32_t)boot_info->highmem_phy_start);
+    uint32_t stop_high_addr  = MIN_PAGE_ALIGN(boot_info->highmem_phy_end);
+
+    zone_init("HighMem", ZONE_HIGHMEM, start_high_addr, stop_high_addr, 0);
+    //=======================================================================
+
+    pr_debug("Memory Size                                : %u MB \n", mem_size / M);
+    pr_debug("Total page frames    (MemorySize/4096)     : %u \n", mem_num_frames);
+    pr_debug("mem_map address                            : 0x%p \n", mem_map);
+    pr_debug("Memory Start                               : 0x%p \n", lowmem_phy_start);
+
+    // With the caching enabled, the pmm check is useless.
+    //return pmm_check();
+#if ZONE_BENCHMARK
+    pmm_benchmark();
+#endif
+    return 1;
+}
+
+/// @brief Returns a virtual address the page frame can be reached at.
+/// @param zone the zone of the page.
+/// @param page the page.
+/// @return the address of the page, to be released with __unmap_page.
+static inline uint32_t __map_page(zone_t *zone, page_t *page)
+{
+    if (zone == &contig_page_data->node_zones[ZONE_NORMAL]) {
+        return get_lowmem_address_from_page(page);
+    }
+    // The high memory is reached through a temporary mapping.
+    return virt_map_physical_pages(page, 1);
+}
+
+/// @brief Releases the address returned by __map_page.
+/// @param zone  the zone of the page.
+/// @param vaddr the address of the page.
+static inline void __unmap_page(zone_t *zone, uint32_t vaddr)
+{
+    if (zone != &contig_page_data->node_zones[ZONE_NORMAL]) {
+        virt_unmap(vaddr);
+    }
+}
+
+/// @brief Fills the freed pages with the poison, in the debug mode of the
+/// buddy system, so that a write after the free can be caught.
+/// @param zone  the zone of the pages.
+/// @param page  the first page.
+/// @param count the number of pages.
+static void __poison_pages(zone_t *zone, page_t *page, uint32_t count)
+{
+#if BB_DEBUG
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t vaddr = __map_page(zone, &page[i]);
+        memset((void *)vaddr, ZONE_POISON_BYTE, PAGE_SIZE);
+        __unmap_page(zone, vaddr);
+        page[i].bbpage.poisoned = true;
+    }
+#endif
+}
+
+/// @brief Checks that the poisoned pages have not been written since they
+/// were freed, in the debug mode of the buddy system.
+/// @param zone  the zone of the pages.
+/// @param page  the first page.
+/// @param count the number of pages.
+static void __check_poison(zone_t *zone, page_t *page, uint32_t count)
+{
+#if BB_DEBUG
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!page[i].bbpage.poisoned) {
+            continue;
+        }
+        uint32_t vaddr = __map_page(zone, &page[i]);
+        uint8_t *bytes = (uint8_t *)vaddr;
+        uint32_t offset;
+        for (offset = 0; (offset < PAGE_SIZE) && (bytes[offset] == ZONE_POISON_BYTE); ++offset) {}
+        __unmap_page(zone, vaddr);
+        if (offset < PAGE_SIZE) {
+            pr_err("Page 0x%p of zone %s written after the free, at offset %u (last allocated at %p).\n",
+                   get_physical_address_from_page(&page[i]), zone->name, offset, page[i].bbpage.alloc_site);
+            kernel_panic("Use after free of a page!");
+        }
+        page[i].bbpage.poisoned = false;
+    }
+#endif
+}
+
+page_t *alloc_page_cached(gfp_t gfp_mask)
+{
+    zone_t *zone      = get_zone_from_flags(gfp_mask);
+    bb_page_t *bbpage = bb_alloc_page_cached(&zone->buddy_system);
+    if (bbpage) {
+        __check_poison(zone, PG_FROM_BBSTRUCT(bbpage, page_t, bbpage), 1);
+#if BB_DEBUG
+        bbpage->alloc_site = __builtin_return_address(0);
+#endif
+    }
+    return PG_FROM_BBSTRUCT(bbpage, page_t, bbpage);
+}
+
+void free_page_cached(page_t *page)
+{
+    zone_t *zone = get_zone_from_page(page);
+    __poison_pages(zone, page, 1);
+    bb_free_page_cached(&zone->buddy_system, &page->bbpage);
+}
+
+uint32_t __alloc_page_lowmem(gfp_t gfp_mask)
+{
+    return get_lowmem_address_from_page(alloc_page_cached(gfp_mask));
+}
+
+void free_page_lowmem(uint32_t addr)
+{
+    page_t *page = get_lowmem_page_from_address(addr);
+    free_page_cached(page);
+}
+
+uint32_t __alloc_pages_lowmem(gfp_t gfp_mask, uint32_t order)
+{
+    assert((order <= (MAX_BUDDYSYSTEM_GFP_ORDER - 1)) && gfp_mask == GFP_KERNEL && "Order is exceeding limit.");
+
+    page_t *page = _alloc_pages(gfp_mask, order);
+
+    // Get the index of the first page frame of the block.
+    uint32_t block_frame_adr = get_lowmem_address_from_page(page);
+    if (block_frame_adr == -1) {
+        pr_emerg("MEM. REQUEST FAILED");
+    }
+#if 0
+    else {
+        pr_debug("BS-G: addr: %p (page: %p order: %d)\n", block_frame_adr, page, order);
+    }
+#endif
+    return block_frame_adr;
+}
+
+/// @brief Fills a page with zeros. `rep stosl` writes four bytes at a time,
+/// while the memset of the kernel goes one byte at a time.
+/// @param addr the address of the page.
+static inline void __zero_page_at(void *addr)
+{
+#if ZONE_ZERO_WITH_MEMSET
+    memset(addr, 0, PAGE_SIZE);
+#else
+    uint32_t count = PAGE_SIZE / sizeof(uint32_t);
+    __asm__ __volatile__("rep stosl"
+                         : "+D"(addr), "+c"(count)
+                         : "a"(0)
+                         : "memory");
+#endif
+}
+
+/// @brief Fills a page frame with zeros, accounting for the time it takes.
+/// @param zone the zone of the page.
+/// @param page the page.
+static void __zero_page(zone_t *zone, page_t *page)
+{
+    uint32_t start = __zone_rdtsc();
+    uint32_t vaddr = __map_page(zone, page);
+    __zero_page_at((void *)vaddr);
+    __unmap_page(zone, vaddr);
+    uint32_t cycles = __zone_rdtsc() - start;
+    // The refill timer updates them too.
+    uint8_t flags = irq_nested_disable();
+    zone->buddy_system.stats.zeroed_pages++;
+    zone->buddy_system.stats.zero_cycles += cycles;
+    irq_nested_enable(flags);
+}
+
+static void __prezero_refill(unsigned long zone_index);
+
+/// @brief Arms the timer which fills the zeroed pages list of the zone.
+/// @param zone_index the index of the zone.
+static void __prezero_arm(unsigned long zone_index)
+{
+    struct timer_list *timer = (struct timer_list *)kmalloc(sizeof(struct timer_list));
+    if (!timer) {
+        return;
+    }
+    init_timer(timer);
+    timer->expires  = timer_get_ticks() + ZONE_PREZERO_TICKS;
+    timer->function = &__prezero_refill;
+    timer->data     = zone_index;
+    add_timer(timer);
+    prezero_armed |= (1U << zone_index);
+}
+
+/// @brief Zeroes a batch of pages in the background, and puts them in the
+/// zeroed pages list of the zone. The timer is armed again until the list is
+/// full, and then by the first allocation that takes a page from it.
+/// @param zone_index the index of the zone.
+static void __prezero_refill(unsigned long zone_index)
+{
+    zone_t *zone = contig_page_data->node_zones + zone_index;
+    prezero_armed &= ~(1U << zone_index);
+    for (unsigned int i = 0; (i < ZONE_PREZERO_BATCH) && bb_zeroed_pages_missing(&zone->buddy_system); ++i) {
+        bb_page_t *bbpage = bb_alloc_page_cached(&zone->buddy_system);
+        if (!bbpage) {
+            // Do not take the last free pages.
+            return;
+        }
+        __check_poison(zone, PG_FROM_BBSTRUCT(bbpage, page_t, bbpage), 1);
+        __zero_page(zone, PG_FROM_BBSTRUCT(bbpage, page_t, bbpage));
+        bb_free_page_zeroed(&zone->buddy_system, bbpage);
+    }
+    if (bb_zeroed_pages_missing(&zone->buddy_system)) {
+        __prezero_arm(zone_index);
+    }
+}
+
+#if ZONE_STRESS_IRQ
+/// The number of ticks the stress test runs for.
+#define ZONE_STRESS_TICKS 2000
+/// The number of operations at each tick.
+#define ZONE_STRESS_BATCH 8
+/// The number of blocks held across the ticks.
+#define ZONE_STRESS_SLOTS 32
+
+/// The blocks held by the stress test.
+static bb_page_t *stress_pages[ZONE_STRESS_SLOTS];
+/// The order of each held block.
+static uint32_t stress_orders[ZONE_STRESS_SLOTS];
+/// Set once the stress test has started.
+static bool_t stress_armed;
+/// The ticks the stress test has run for.
+static uint32_t stress_ticks;
+/// The operations done, and the allocations which failed.
+static uint32_t stress_ops, stress_failed;
+/// The state of the pseudo-random generator of the stress test.
+static uint32_t stress_seed = 1;
+
+static void __stress_tick(unsigned long zone_index);
+
+/// @brief Frees the block held in the given slot of the stress test.
+/// @param buddy the buddy system of the zone.
+/// @param slot  the slot.
+static inline void __stress_free(bb_instance_t *buddy, uint32_t slot)
+{
+    if (stress_orders[slot] == 0) {
+        bb_free_page_cached(buddy, stress_pages[slot]);
+    } else {
+        bb_free_pages(buddy, stress_pages[slot]);
+    }
+    stress_pages[slot] = NULL;
+}
+
+/// @brief Arms the timer running the next step of the stress test.
+/// @param zone_index the index of the zone.
+static void __stress_arm(unsigned long zone_index)
+{
+    struct timer_list *timer = (struct timer_list *)kmalloc(sizeof(struct timer_list));
+    if (!timer) {
+        return;
+    }
+    init_timer(timer);
+    timer->expires  = timer_get_ticks() + 1;
+    timer->function = &__stress_tick;
+    timer->data     = zone_index;
+    add_timer(timer);
+}
+
+/// @brief Allocates and frees blocks of random order from the timer
+/// interrupt, single pages going through the per-cpu cache. At the end all
+/// the blocks are freed and the consistency of the buddy system is checked.
+/// @param zone_index the index of the zone.
+static void __stress_tick(unsigned long zone_index)
+{
+    bb_instance_t *buddy = &contig_page_data->node_zones[zone_index].buddy_system;
+    for (uint32_t i = 0; i < ZONE_STRESS_BATCH; ++i, ++stress_ops) {
+        stress_seed   = (stress_seed * 1103515245U) + 12345U;
+        uint32_t slot = (stress_seed >> 16) % ZONE_STRESS_SLOTS, order = (stress_seed >> 8) % 4;
+        if (stress_pages[slot]) {
+            __stress_free(buddy, slot);
+        } else {
+            stress_pages[slot]  = order ? bb_alloc_pages(buddy, order) : bb_alloc_page_cached(buddy);
+            stress_orders[slot] = order;
+            if (!stress_pages[slot]) {
+                ++stress_failed;
+            }
+        }
+    }
+    if (++stress_ticks < ZONE_STRESS_TICKS) {
+        __stress_arm(zone_index);
+        return;
+    }
+    for (uint32_t slot = 0; slot < ZONE_STRESS_SLOTS; ++slot) {
+        if (stress_pages[slot]) {
+            __stress_free(buddy, slot);
+        }
+    }
+    pr_notice("pmmstress ticks=%u ops=%u failed=%u errors=%d\n",
+              stress_ticks, stress_ops, stress_failed, buddy_system_check(buddy));
+}
+#endif
+
+page_t *_alloc_pages(gfp_t gfp_mask, uint32_t order)
+{
+    uint32_t block_size = 1UL << order;
+
+    zone_t *zone = get_zone_from_flags(gfp_mask);
+    page_t *page = NULL;
+    bb_page_t *bbpage = NULL;
+
+#if ZONE_STRESS_IRQ
+    // The timers work once the ticks have started.
+    if (!stress_armed && timer_get_ticks()) {
+        stress_armed = true;
+        __stress_arm(ZONE_NORMAL);
+    }
+#endif
+
+    if ((gfp_mask & __GFP_ZERO) && (order == 0)) {
+        // Take a page already zeroed, and have the list refilled in the background.
+        bbpage = bb_alloc_page_zeroed(&zone->buddy_system);
+        unsigned long zone_index = zone - contig_page_data->node_zones;
+        if (!(prezero_armed & (1U << zone_index))) {
+            __prezero_arm(zone_index);
+        }
+        if (bbpage) {
+            gfp_mask &= ~__GFP_ZERO;
+        }
+    }
+
+    // Search for a block of page frames by using the BuddySystem.
+    if (!bbpage) {
+        bbpage = bb_alloc_pages_type(&zone->buddy_system, order, get_migrate_type_from_flags(gfp_mask));
+    }
+    page = PG_FROM_BBSTRUCT(bbpage, page_t, bbpage);
+
+    if (bbpage) {
+        __check_poison(zone, page, block_size);
+#if BB_DEBUG
+        bbpage->alloc_site = __builtin_return_address(0);
+#endif
+    }
+
+    // Set page counters
+    for (int i = 0; i < block_size; i++) {
+        set_page_count(&page[i], 1);
+    }
+
+    // Zero the pages that did not come from the zeroed list.
+    if (bbpage && (gfp_mask & __GFP_ZERO)) {
+        for (int i = 0; i < block_size; i++) {
+            __zero_page(zone, &page[i]);
+        }
+    }
+
+    assert(page && "Cannot allocate pages.");
+
+    // Decrement the number of pages in the zone.
+    if (page) {
+        zone->free_pages -= block_size;
+    }
+
+    return page;
+}
+
+unsigned int _alloc_pages_bulk(gfp_t gfp_mask, uint32_t order, unsigned int count, page_t **pages)
+{
+    uint32_t block_size = 1UL << order;
+
+    zone_t *zone           = get_zone_from_flags(gfp_mask);
+    bb_migrate_type_t type = get_migrate_type_from_flags(gfp_mask);
+    bb_page_t *batch[ZONE_BULK_BATCH];
+    unsigned int allocated = 0;
+
+    while (allocated < count) {
+        unsigned int wanted = min(count - allocated, ZONE_BULK_BATCH);
+        unsigned int got    = bb_alloc_pages_bulk(&zone->buddy_system, order, type, wanted, batch);
+
+        for (unsigned int i = 0; i < got; i++) {
+            page_t *page = PG_FROM_BBSTRUCT(batch[i], page_t, bbpage);
+            __check_poison(zone, page, block_size);
+#if BB_DEBUG
+            batch[i]->alloc_site = __builtin_return_address(0);
+#endif
+            for (int j = 0; j < block_size; j++) {
+                set_page_count(&page[j], 1);
+                if (gfp_mask & __GFP_ZERO) {
+                    __zero_page(zone, &page[j]);
+                }
+            }
+            pages[allocated++] = page;
+        }
+        zone->free_pages -= got * block_size;
+
+        if (got < wanted) {
+            break;
+        }
+    }
+    return allocated;
+}
+
+page_t *_alloc_pages_contig(gfp_t gfp_mask, uint32_t order)
+{
+    uint32_t block_size = 1UL << order;
+
+    zone_t *zone = get_zone_from_flags(gfp_mask);
+    bb_page_t *bbpage = bb_alloc_pages_contig(&zone->buddy_system, order);
+    if (!bbpage) {
+        pr_warning("Cannot allocate %u contiguous pages from zone %s.\n", block_size, zone->name);
+        return NULL;
+    }
+    page_t *page = PG_FROM_BBSTRUCT(bbpage, page_t, bbpage);
+    __check_poison(zone, page, block_size);
+#if BB_DEBUG
+    bbpage->alloc_site = __builtin_return_address(0);
+#endif
+
+    // Set page counters
+    for (int i = 0; i < block_size; i++) {
+        set_page_count(&page[i], 1);
+    }
+
+    // Decrement the number of pages in the zone.
+    zone->free_pages -= block_size;
+
+    return page;
+}
+
+void free_pages_lowmem(uint32_t addr)
+{
+    page_t *page = get_lowmem_page_from_address(addr);
+    assert(page && "Page is over memory size.");
+    __free_pages(page);
+}
+
+void __free_pages(page_t *page)
+{
+    zone_t *zone = get_zone_from_page(page);
+    assert(zone && "Page is over memory size.");
+
+    assert(zone->zone_mem_map <= page && "Page is below the selected zone!");
+
+    uint32_t order      = page->bbpage.order;
+    uint32_t block_size = 1UL << order;
+
+    for (int i = 0; i < block_size; i++) {
+        set_page_count(&page[i], 0);
+    }
+
+    __poison_pages(zone, page, block_size);
+    bb_free_pages(&zone->buddy_system, &page->bbpage);
+
+    zone->free_pages += block_size;
+#if 0
+    pr_debug("BS-F: (page: %p order: %d)\n", page, order);
+#endif
+    //buddy_system_dump(&zone->buddy_system);
+}
+
+void __free_pages_bulk(page_t **pages, unsigned int count)
+{
+    bb_page_t *batch[ZONE_BULK_BATCH];
+    unsigned int queued = 0;
+    zone_t *zone        = NULL;
+
+    for (unsigned int i = 0; i < count; i++) {
+        zone_t *page_zone = get_zone_from_page(pages[i]);
+        assert(page_zone && "Page is over memory size.");
+
+        // Blocks of another zone, or a full batch, flush what was queued.
+        if ((queued == ZONE_BULK_BATCH) || (queued && (page_zone != zone))) {
+            bb_free_pages_bulk(&zone->buddy_system, batch, queued);
+            queued = 0;
+        }
+        zone = page_zone;
+
+        uint32_t block_size = 1UL << pages[i]->bbpage.order;
+        for (int j = 0; j < block_size; j++) {
+            set_page_count(&pages[i][j], 0);
+        }
+        __poison_pages(zone, pages[i], block_size);
+        zone->free_pages += block_size;
+
+        batch[queued++] = &pages[i]->bbpage;
+    }
+    if (queued) {
+        bb_free_pages_bulk(&zone->buddy_system, batch, queued);
+    }
+}
+
+void __split_pages(page_t *page)
+{
+    zone_t *zone = get_zone_from_page(page);
+    assert(zone && "Page is over memory size.");
+
+    bb_split_pages(&zone->buddy_system, &page->bbpage);
+}
+
+unsigned long get_zone_total_space(gfp_t gfp_mask)
+{
+    zone_t *zone = get_zone_from_flags(gfp_mask);
+    assert(zone && "Cannot retrieve the correct zone.");
+    return buddy_system_get_total_space(&zone->buddy_system);
+}
+
+unsigned long get_zone_free_space(gfp_t gfp_mask)
+{
+    zone_t *zone = get_zone_from_flags(gfp_mask);
+    assert(zone && "Cannot retrieve the correct zone.");
+    return buddy_system_get_free_space(&zone->buddy_system);
+}
+
+unsigned long get_zone_cached_space(gfp_t gfp_mask)
+{
+    zone_t *zone = get_zone_from_flags(gfp_mask);
+    assert(zone && "Cannot retrieve the correct zone.");
+    return buddy_system_get_cached_space(&zone->buddy_system);
+}